@@ -12,19 +12,33 @@
 
 struct addrspace;
 struct lpage;
+struct tlbshootdown;
 
 #define INVALID_PADDR ((paddr_t)0)
 
 void 	mmu_setas (struct addrspace *as);
 void 	mmu_unmap (struct addrspace *as, vaddr_t va);
+void 	mmu_unmappage (paddr_t pa);
 void 	mmu_map (struct addrspace *as, vaddr_t va, paddr_t pa, int writable);
+int 	mmu_prefault (struct addrspace *as, vaddr_t va, paddr_t pa, int writable);
+void 	mmu_protect (struct addrspace *as, vaddr_t va);
+void 	mmu_batchbegin (struct addrspace *as);
+void 	mmu_batchend (struct addrspace *as);
+void 	mmu_shootdown (const struct tlbshootdown *ts);
+void 	mmu_shootdown_all (void);
+int 	mmu_setpolicy (const char *name);
+void 	mmu_printstats (void);
 
 void 	cm_bootstrap (void);
 
 paddr_t	cm_allocuserpage (struct lpage *lp);
+paddr_t	cm_allocuserzero (struct lpage *lp);
 void 	cm_copypage (paddr_t frompa, paddr_t topa);
 void 	cm_zero (paddr_t paddr);
 void 	cm_deallocpage (paddr_t page, int iskern);
+int 	cm_zeroidle (void);
+void 	cm_framecounts (unsigned *kern, unsigned *user, unsigned *free);
+void 	cm_printzerostats (void);
 
 void 	cm_pin (paddr_t paddr);
 int 	cm_pageispinned (paddr_t paddr);
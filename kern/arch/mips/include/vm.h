@@ -115,10 +115,15 @@ void ram_getsize(paddr_t *lo, paddr_t *hi);
 
 struct tlbshootdown {
 	/*
-	 * Change this to what you need for your VM design.
+	 * Either every mapping of the frame at ts_paddr, or if that is
+	 * 0, the one page ts_vaddr of the address space that had ASID
+	 * ts_asid in generation ts_asidgen. The target never looks at
+	 * the addrspace itself, which may be gone by the time it does.
 	 */
-	struct addrspace *ts_addrspace;
+	unsigned ts_asid;
+	unsigned ts_asidgen;
 	vaddr_t ts_vaddr;
+	paddr_t ts_paddr;
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -36,6 +36,7 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include "opt-dumbvm.h"
 
 
 /*
@@ -86,6 +87,9 @@ syscall(struct trapframe *tf)
   int64_t retval64;
   int err;
   int32_t stackarg1;
+#if !OPT_DUMBVM
+  off_t stackarg64;
+#endif
 
   KASSERT(curthread != NULL);
   KASSERT(curthread->t_curspl == 0);
@@ -159,6 +163,33 @@ syscall(struct trapframe *tf)
     case SYS___getcwd:
       err = sys___getcwd((userptr_t)tf->tf_a0, tf->tf_a1, &retval);
       break;
+#if !OPT_DUMBVM
+    case SYS_sbrk:
+      err = sys_sbrk((intptr_t)tf->tf_a0, &retval);
+      break;
+    case SYS_mmap:
+      /* fd is at sp+16; the 64-bit offset is aligned to sp+24 */
+      err = copyin((const_userptr_t) tf->tf_sp + 16, &stackarg1, sizeof(int32_t));
+      if (err) {
+        break;
+      }
+      err = copyin((const_userptr_t) tf->tf_sp + 24, &stackarg64, sizeof(off_t));
+      if (err) {
+        break;
+      }
+      err = sys_mmap((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3,
+          stackarg1, stackarg64, &retval);
+      break;
+    case SYS_munmap:
+      err = sys_munmap((userptr_t)tf->tf_a0, tf->tf_a1);
+      break;
+    case SYS_msync:
+      err = sys_msync((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2);
+      break;
+    case SYS___vmstat:
+      err = sys___vmstat((userptr_t)tf->tf_a0, tf->tf_a1);
+      break;
+#endif
     default:
       kprintf("Unknown syscall %d\n", callno);
       err = ENOSYS;
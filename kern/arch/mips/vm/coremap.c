@@ -18,12 +18,17 @@
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <platform/maxcpus.h>
 #include <vfs.h>
 #include <vnode.h>
 #include <kern/stat.h>
 #include <bitmap.h>
 #include <synch.h>
 #include <uio.h>
+#include <vmstat.h>
+#include <buf.h>
 
 struct lock *paging_lock;
 
@@ -31,21 +36,133 @@ struct cm_entry {
 	struct lpage *lpage;
 	unsigned kernel:1;		// kernel page
 	unsigned allocated:1;
-	volatile unsigned pinned:1; 	// page is busy
+	unsigned referenced:1;		// faulted on since last clock sweep
+	unsigned tlbmulti:1;		// may be in the TLB more than once
+	unsigned notlast:1;		// kernel run continues in next frame
 	int tlbindex:7; 		// tlb index
-	struct wchan *wchan;
+	uint32_t tlbcpus;		// cpus whose TLB may map the frame
+	// other cpus write these, so each is a byte of its own rather than
+	// a bit in the word above
+	volatile uint8_t pinned; 	// page is busy
+	uint8_t onlist;			// free, on the free list
+	uint8_t cached;			// free, in some cpu's page cache
+	uint8_t reserved;		// free, held for a kernel run
+	int freenext;			// free list links, -1 at the ends
+	int freeprev;
 };
 
 static unsigned cm_entries;
-static unsigned cm_kernpages;	/* pages allocated to the kernel */
-static unsigned cm_userpages;	/* pages allocated to user progs */
-static unsigned cm_freepages;
 static unsigned cm_basepage;
-static unsigned cm_nexttlb;
+static unsigned cm_clockhand;	/* next frame the clock looks at */
 
 // ensure at least 8 non-kernel pages available in memory
 #define CM_MIN_SLACK		8
 
+// times a multi-page allocation rescans after losing a race for a frame
+#define CM_RUN_TRIES		4
+
+// free frames
+// - a free frame is on the free list, in exactly one cpu's page cache,
+//   reserved for a kernel run, or pinned by a stale cm_pin (cm_unpin
+//   puts it back)
+// - a cpu takes frames from its own cache with only interrupts off, and
+//   goes to the list under cm_freelock a batch at a time
+// - onlist only changes under cm_freelock, and a frame only leaves the
+//   list under it, so whoever takes it off owns it; cached and reserved
+//   are then only written by that owner
+// - pinned is set and cleared holding the frame's wait channel lock
+// - each cpu's cache also has a pool of frames it zeroed while idle;
+//   they are marked cached like the rest, and only go to other uses
+//   when there is nothing else
+#define CM_PCPU_MAX		8	/* frames a cpu may cache */
+#define CM_PCPU_BATCH		4	/* frames moved per refill */
+#define CM_PCPU_ZERO		8	/* zeroed frames a cpu may keep */
+
+// frame counts
+// - kept per cpu, as changes since boot, and summed on read, so the
+//   lockless allocation path never writes a counter another cpu writes
+// - a cpu's counts only change with interrupts off; one cpu's may go
+//   negative when it frees frames another cpu allocated, but they
+//   always sum to zero
+struct cm_pcpu {
+	unsigned count;
+	int frames[CM_PCPU_MAX];
+	unsigned zcount;
+	int zframes[CM_PCPU_ZERO];
+	int kernpages;			// pages allocated to the kernel
+	int userpages;			// pages allocated to user progs
+	int freepages;
+};
+
+static struct spinlock cm_freelock;
+static int cm_freehead;
+static struct cm_pcpu cm_pcpu[MAXCPUS];
+
+// pageout daemon wakes below cm_lowater free frames, sleeps at cm_hiwater
+static unsigned cm_lowater;
+static unsigned cm_hiwater;
+static struct cv *cm_pageout_cv;
+
+// address space IDs
+// - ASIDs are handed out in generations; when they run out, every cpu
+//   flushes its TLB before using one from the next generation
+#define NUM_ASID		((TLBHI_PID >> TLBHI_PIDSHIFT) + 1)
+#define ASID_KERNEL		0	/* no user address space */
+
+static struct spinlock cm_asidlock;
+static unsigned cm_nextasid;
+static unsigned cm_asidgen;
+static unsigned cm_cpuasidgen[MAXCPUS];	/* generation in each TLB */
+static unsigned cm_curasid[MAXCPUS];
+static struct addrspace *cm_curas[MAXCPUS];
+
+// TLB shootdown
+// - each cpu that has run user code is recorded in cm_cpus; each
+//   address space keeps the cpus that may hold its translations in
+//   as_cpus, and each frame the cpus that mapped it in tlbcpus, so
+//   only cpus that might have a stale entry are interrupted
+// - requests queue in the target's c_shootdown until it takes the IPI;
+//   past TLBSHOOTDOWN_MAX it just flushes everything
+// - the sender waits for the target to drain its queue before relying
+//   on the entries being gone
+static struct cpu *cm_cpus[MAXCPUS];
+
+// TLB replacement policies
+#define TLBPOLICY_RR		0	/* round-robin */
+#define TLBPOLICY_RANDOM	1	/* random slot from the random device */
+#define TLBPOLICY_LRU		2	/* approximate LRU from the coremap */
+
+static const char *const cm_tlbpolicynames[] = { "rr", "random", "lru" };
+#define NUM_TLBPOLICY	(sizeof(cm_tlbpolicynames) / sizeof(cm_tlbpolicynames[0]))
+
+static unsigned cm_tlbpolicy;
+static unsigned cm_tlbnext[MAXCPUS];	/* slots below this have been used */
+static unsigned cm_tlbhand[MAXCPUS];	/* next slot rr/lru looks at */
+
+// TLB statistics
+static uint32_t cm_stat_tlbrefills[MAXCPUS];	/* entries loaded by mmu_map */
+static uint32_t cm_stat_tlbevictions[MAXCPUS];	/* valid entries replaced */
+static uint32_t cm_stat_asswitches;	/* mmu_setas to a new as */
+static uint32_t cm_stat_tlbflushes;	/* whole-TLB invalidations */
+static uint32_t cm_stat_asidrollovers;	/* ASID generations used up */
+static uint32_t cm_stat_shootsent[MAXCPUS];	/* shootdowns sent */
+static uint32_t cm_stat_shootrecv[MAXCPUS];	/* shootdowns handled */
+static uint32_t cm_stat_shootall[MAXCPUS];	/* queue overflowed, flushed */
+
+// zeroed pool statistics
+static uint32_t cm_stat_zerohits[MAXCPUS];	/* zero fills from the pool */
+static uint32_t cm_stat_zeromisses[MAXCPUS];	/* zero fills done in place */
+static uint32_t cm_stat_zeroidle[MAXCPUS];	/* frames zeroed while idle */
+
+// frame wait queues
+// - threads waiting for a frame to be unpinned sleep on one of a fixed
+//   set of channels, picked by hashing the frame number; frames that
+//   collide share a channel and sleepers recheck their own frame
+// - so pinning never allocates, and no per-frame pointer is needed
+#define CM_WAITQS		64	/* power of two */
+
+static struct wchan *cm_waitqs[CM_WAITQS];
+
 #define COREMAP_TO_PADDR(i)	(((paddr_t)PAGE_SIZE)*((i)+cm_basepage))
 #define PADDR_TO_COREMAP(page)	(((page)/PAGE_SIZE) - cm_basepage)
 
@@ -60,7 +177,29 @@ cm_bootstrap (void)
 
 	DEBUG(DB_VM, "Coremap: cm_bootstrap\n");
 
-	cm_nexttlb = 0;
+	cm_clockhand = 0;
+	cm_tlbpolicy = TLBPOLICY_LRU;
+
+	spinlock_init(&cm_asidlock);
+	cm_nextasid = ASID_KERNEL + 1;
+	cm_asidgen = 1;
+	for (i = 0; i < MAXCPUS; i++) {
+		cm_cpuasidgen[i] = 0;
+		cm_curasid[i] = ASID_KERNEL;
+		cm_curas[i] = NULL;
+		cm_tlbnext[i] = 0;
+		cm_tlbhand[i] = 0;
+		cm_stat_tlbrefills[i] = 0;
+		cm_stat_tlbevictions[i] = 0;
+		cm_pcpu[i].count = 0;
+		cm_pcpu[i].zcount = 0;
+		cm_pcpu[i].kernpages = 0;
+		cm_pcpu[i].userpages = 0;
+		cm_pcpu[i].freepages = 0;
+		cm_stat_zerohits[i] = 0;
+		cm_stat_zeromisses[i] = 0;
+		cm_stat_zeroidle[i] = 0;
+	}
 
 	ram_getsize(&first, &last);
 
@@ -81,9 +220,14 @@ cm_bootstrap (void)
 
 	cm_basepage = first / PAGE_SIZE;
 	cm_entries = (last / PAGE_SIZE) - cm_basepage;
-	cm_kernpages = 0;
-	cm_userpages = 0;
-	cm_freepages = cm_entries;
+
+	// 1/64th of RAM, but never less than the kernel's slack
+	cm_lowater = cm_entries / 64;
+	if (cm_lowater < CM_MIN_SLACK) {
+		cm_lowater = CM_MIN_SLACK;
+	}
+	cm_hiwater = 2 * cm_lowater;
+	cm_pageout_cv = NULL;
 
 	KASSERT(cm_entries + (cmsize / PAGE_SIZE) == npages);
 
@@ -93,29 +237,178 @@ cm_bootstrap (void)
 		coremap[i].kernel = 0;
 		coremap[i].allocated = 0;
 		coremap[i].pinned = 0;
+		coremap[i].referenced = 0;
+		coremap[i].tlbmulti = 0;
+		coremap[i].notlast = 0;
+		coremap[i].onlist = 1;
+		coremap[i].cached = 0;
+		coremap[i].reserved = 0;
 		coremap[i].tlbindex = -1;
+		coremap[i].tlbcpus = 0;
+	}
+
+	// thread the free list through the coremap, low frames first
+	spinlock_init(&cm_freelock);
+	for (i = 0; i < cm_entries; i++) {
+		coremap[i].freeprev = (int)i - 1;
+		coremap[i].freenext = (i + 1 < cm_entries) ? (int)i + 1 : -1;
+	}
+	cm_freehead = (cm_entries > 0) ? 0 : -1;
+
+	// the coremap works now, so kmalloc does too
+	for (i = 0; i < CM_WAITQS; i++) {
+		cm_waitqs[i] = wchan_create("frame");
+		if (cm_waitqs[i] == NULL) {
+			panic("cm_bootstrap: Out of memory\n");
+		}
 	}
 
 }
 
+// Gets the Wait Channel for a Frame.
+static struct wchan *
+frame_waitq (unsigned where)
+{
+
+	KASSERT(where < cm_entries);
+	return (cm_waitqs[where & (CM_WAITQS - 1)]);
+
+}
+
+// Wakes Anyone Waiting for a Frame.
+// - everyone on the shared channel wakes; the others go back to sleep
+static void
+frame_wake (unsigned where)
+{
+
+	wchan_wakeall(frame_waitq(where));
+
+}
+
+// Pins a Frame Unless Someone Already Has.
+// - the wait channel lock keeps a cm_pin on another cpu from seeing
+//   the frame unpinned too
+// - returns 0 if it was pinned
+static int
+frame_trypin (unsigned where)
+{
+
+	struct wchan *wc;
+	int rv;
+
+	wc = frame_waitq(where);
+	wchan_lock(wc);
+	rv = !coremap[where].pinned;
+	coremap[where].pinned = 1;
+	wchan_unlock(wc);
+
+	return (rv);
+
+}
+
+// Unpins a Frame and Wakes its Waiters.
+static void
+frame_unpin (unsigned where)
+{
+
+	struct wchan *wc;
+
+	wc = frame_waitq(where);
+	wchan_lock(wc);
+	KASSERT(coremap[where].pinned);
+	coremap[where].pinned = 0;
+	wchan_unlock(wc);
+
+	frame_wake(where);
+
+}
+
 ///// TLB /////
 
+// Picks a TLB Slot to Replace the Approximately Least Recently Used Entry.
+// - the MIPS TLB keeps no use bits, so a hand sweeps the slots and takes
+//   the first entry that is invalid, belongs to an address space not
+//   running here, or maps a frame the clock has found unreferenced
+// - the coremap tlbindex hint tells a stale duplicate from the live entry
+static unsigned
+tlb_replace_lru (unsigned me)
+{
+
+	uint32_t ehi; uint32_t elo;
+	unsigned slot; unsigned cmix; unsigned n;
+
+	for (n = 0; n < NUM_TLB; n++) {
+		slot = cm_tlbhand[me];
+		cm_tlbhand[me] = (slot + 1) % NUM_TLB;
+
+		tlb_read(&ehi, &elo, slot);
+		if (!(elo & TLBLO_VALID)) {
+			return (slot);
+		}
+		if (((ehi & TLBHI_PID) >> TLBHI_PIDSHIFT) != cm_curasid[me]) {
+			return (slot);
+		}
+
+		cmix = PADDR_TO_COREMAP(elo & TLBLO_PPAGE);
+		KASSERT(cmix < cm_entries);
+		if (coremap[cmix].tlbindex != (int)slot) {
+			return (slot);
+		}
+		if (!coremap[cmix].referenced) {
+			return (slot);
+		}
+	}
+
+	// everything is hot; fall back to round-robin
+	slot = cm_tlbhand[me];
+	cm_tlbhand[me] = (slot + 1) % NUM_TLB;
+	return (slot);
+
+}
+
 // - returns index of tlb entry to replace
-static unsigned 
-tlb_replace (void) 
+static unsigned
+tlb_replace (void)
 {
 
-	uint32_t slot;
+	unsigned me; unsigned slot;
 
 	DEBUG(DB_VM, "Coremap: tlb_replace\n");
-	
+
 	KASSERT(curthread -> t_curspl > 0);
 
-	slot = 0;
-	slot = (slot + 1) % NUM_TLB;
+	me = curcpu -> c_number;
+
+	switch (cm_tlbpolicy) {
+	    case TLBPOLICY_RANDOM:
+		slot = random() % NUM_TLB;
+		break;
+	    case TLBPOLICY_LRU:
+		slot = tlb_replace_lru(me);
+		break;
+	    case TLBPOLICY_RR:
+	    default:
+		slot = cm_tlbhand[me];
+		cm_tlbhand[me] = (slot + 1) % NUM_TLB;
+		break;
+	}
+
+	KASSERT(slot < NUM_TLB);
 	return (slot);
 
 }
+
+// Reloads the Current ASID into ENTRYHI.
+// - tlb_read/tlb_write/tlb_probe all clobber it
+static void
+tlb_restoreasid (void)
+{
+
+	KASSERT(curthread -> t_curspl > 0);
+	tlb_setentryhi(cm_curasid[curcpu -> c_number] << TLBHI_PIDSHIFT);
+
+}
+
 // - marks tlb entry as invalid
 static void
 tlb_invalidate (int tlbindex)
@@ -134,8 +427,10 @@ tlb_invalidate (int tlbindex)
 		pa = elo & TLBLO_PPAGE;
 		cmix = PADDR_TO_COREMAP(pa);
 		KASSERT(cmix < cm_entries);
-		KASSERT(coremap[cmix].tlbindex == tlbindex);
-		coremap[cmix].tlbindex = -1;
+		// a shared frame may still be mapped under another ASID
+		if (coremap[cmix].tlbindex == tlbindex) {
+			coremap[cmix].tlbindex = -1;
+		}
 	}
 
 	tlb_write(TLBHI_INVALID(tlbindex), TLBLO_INVALID(), tlbindex);
@@ -156,13 +451,14 @@ tlb_clear (void)
 	for (i = 0; i < NUM_TLB; i++) {
 		tlb_invalidate(i);
 	}
-	cm_nexttlb = 0;
+	cm_tlbnext[curcpu -> c_number] = 0;
+	cm_stat_tlbflushes++;
 
 }
 
 // Searches and Invalidates a TLB Entry for a vaddr Translation.
 static void
-tlb_unmap (vaddr_t va)
+tlb_unmap (vaddr_t va, unsigned asid)
 {
 
 	int i;
@@ -173,7 +469,7 @@ tlb_unmap (vaddr_t va)
 	KASSERT(curthread -> t_curspl > 0);
 	KASSERT(va < MIPS_KSEG0);
 
-	i = tlb_probe(va & PAGE_FRAME, 0);
+	i = tlb_probe((va & PAGE_FRAME) | (asid << TLBHI_PIDSHIFT), 0);
 	if (i < 0) { return; }
 	
 	tlb_read(&ehi, &elo, i);
@@ -184,187 +480,1269 @@ tlb_unmap (vaddr_t va)
 
 }
 
+// Invalidates every Entry in this TLB for a Frame.
+static void
+tlb_purge_paddr (paddr_t pa)
+{
+
+	uint32_t elo; uint32_t ehi;
+	int i;
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	for (i = 0; i < NUM_TLB; i++) {
+		tlb_read(&ehi, &elo, i);
+		if ((elo & TLBLO_VALID) && (elo & TLBLO_PPAGE) == pa) {
+			tlb_invalidate(i);
+		}
+	}
+
+}
+
+// Queues a Shootdown on other CPUs.
+// - the targets are interrupted but not waited for
+static void
+tlb_shootpost (uint32_t mask, const struct tlbshootdown *ts)
+{
+
+	unsigned me; unsigned i;
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	me = curcpu -> c_number;
+	for (i = 0; i < MAXCPUS; i++) {
+		if (i == me || !(mask & ((uint32_t)1 << i)) || cm_cpus[i] == NULL) {
+			continue;
+		}
+		ipi_tlbshootdown(cm_cpus[i], ts);
+		cm_stat_shootsent[me]++;
+	}
+
+}
+
+// Waits for other CPUs to Handle their Queued Shootdowns.
+// - must not be called holding a spinlock, since a target spinning for
+//   it with interrupts off would never take our IPI
+// - with interrupts off we answer our own queue while we spin, or two
+//   cpus shooting at each other would wait forever
+static void
+tlb_shootwait (uint32_t mask)
+{
+
+	struct cpu *c = NULL;
+	unsigned me; unsigned i;
+	int busy;
+
+	me = curcpu -> c_number;
+	for (i = 0; i < MAXCPUS; i++) {
+
+		if (i == me || !(mask & ((uint32_t)1 << i)) || cm_cpus[i] == NULL) {
+			continue;
+		}
+		c = cm_cpus[i];
+
+		do {
+			spinlock_acquire(&c -> c_ipi_lock);
+			busy = c -> c_ipi_pending & (1U << IPI_TLBSHOOTDOWN);
+			spinlock_release(&c -> c_ipi_lock);
+			if (busy && curthread -> t_curspl > 0 &&
+			    (curcpu -> c_ipi_pending & (1U << IPI_TLBSHOOTDOWN))) {
+				interprocessor_interrupt();
+			}
+		} while (busy);
+
+	}
+
+}
+
+// Invalidates every TLB Entry for a Frame, whatever its ASID.
+// - other cpus that mapped it are shot down and waited for, since the
+//   frame is about to be reused
+static void
+tlb_unmap_paddr (paddr_t pa)
+{
+
+	struct tlbshootdown ts;
+	uint32_t others;
+	unsigned cmix;
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	cmix = PADDR_TO_COREMAP(pa);
+	KASSERT(cmix < cm_entries);
+
+	others = coremap[cmix].tlbcpus & ~((uint32_t)1 << curcpu -> c_number);
+	if (others != 0) {
+		ts.ts_asid = ASID_KERNEL;
+		ts.ts_asidgen = 0;
+		ts.ts_vaddr = 0;
+		ts.ts_paddr = pa;
+		tlb_shootpost(others, &ts);
+		tlb_shootwait(others);
+	}
+	coremap[cmix].tlbcpus = 0;
+
+	// the common case: one mapping, and we know where
+	if (!coremap[cmix].tlbmulti) {
+		if (coremap[cmix].tlbindex >= 0) {
+			tlb_invalidate(coremap[cmix].tlbindex);
+		}
+		KASSERT(coremap[cmix].tlbindex < 0);
+		return;
+	}
+
+	tlb_purge_paddr(pa);
+	coremap[cmix].tlbmulti = 0;
+	KASSERT(coremap[cmix].tlbindex < 0);
+
+}
+
 // Gets TLB Slot for use;
 // - may replace an existing one if necessary
 static int
 mipstlb_getslot (void)
 {
 
-	int i;
+	uint32_t ehi; uint32_t elo;
+	unsigned me; int i;
 
 	DEBUG(DB_VM, "Coremap: mipstlb_getslot\n");
 
-	if (cm_nexttlb < NUM_TLB) {
-		return (cm_nexttlb++);
+	me = curcpu -> c_number;
+	if (cm_tlbnext[me] < NUM_TLB) {
+		return (cm_tlbnext[me]++);
 	}
 
 	// evict
 	i = tlb_replace();
+	tlb_read(&ehi, &elo, i);
+	if (elo & TLBLO_VALID) {
+		cm_stat_tlbevictions[me]++;
+		vmstat_inc(VMS_TLBEVICTIONS);
+	}
 	tlb_invalidate(i);
 	return (i);
 
 }
 
-///// Memory Allocation /////
+///// Free Frames /////
 
-static uint32_t 
-find_page_replace (void)
+// Puts a Free Frame on the Free List.
+static void
+freelist_add (unsigned where)
 {
 
-	DEBUG(DB_VM, "Coremap: find_page_replace\n");
+	KASSERT(where < cm_entries);
+	KASSERT(!coremap[where].allocated);
+	KASSERT(!coremap[where].pinned);
+	KASSERT(!coremap[where].onlist);
+	KASSERT(!coremap[where].cached);
+	KASSERT(!coremap[where].reserved);
+
+	spinlock_acquire(&cm_freelock);
+	coremap[where].onlist = 1;
+	coremap[where].freeprev = -1;
+	coremap[where].freenext = cm_freehead;
+	if (cm_freehead >= 0) {
+		coremap[cm_freehead].freeprev = where;
+	}
+	cm_freehead = where;
+	spinlock_release(&cm_freelock);
 
-	return (0);
+}
+
+// Takes a Particular Frame off the Free List.
+// - returns 0 if it isn't on the list; checking under cm_freelock means
+//   another cpu can't have taken it in between
+static int
+freelist_remove (unsigned where)
+{
+
+	int prev; int next;
+
+	KASSERT(where < cm_entries);
+
+	spinlock_acquire(&cm_freelock);
+	if (!coremap[where].onlist) {
+		spinlock_release(&cm_freelock);
+		return (0);
+	}
+	KASSERT(!coremap[where].allocated);
+	coremap[where].onlist = 0;
+	prev = coremap[where].freeprev;
+	next = coremap[where].freenext;
+	if (prev >= 0) {
+		coremap[prev].freenext = next;
+	}
+	else {
+		KASSERT(cm_freehead == (int)where);
+		cm_freehead = next;
+	}
+	if (next >= 0) {
+		coremap[next].freeprev = prev;
+	}
+	coremap[where].freenext = -1;
+	coremap[where].freeprev = -1;
+	spinlock_release(&cm_freelock);
+
+	return (1);
+
+}
+
+// Takes Any Frame off the Free List.
+// - returns -1 if the list is empty
+static int
+freelist_pop (void)
+{
+
+	int where;
+
+	spinlock_acquire(&cm_freelock);
+	where = cm_freehead;
+	if (where >= 0) {
+		cm_freehead = coremap[where].freenext;
+		if (cm_freehead >= 0) {
+			coremap[cm_freehead].freeprev = -1;
+		}
+		KASSERT(coremap[where].onlist);
+		coremap[where].onlist = 0;
+		coremap[where].freenext = -1;
+	}
+	spinlock_release(&cm_freelock);
+
+	KASSERT(where < 0 || !coremap[where].allocated);
+	return (where);
+
+}
+
+// Gets this CPU's Page Cache.
+// - returns NULL before the cpu structures exist
+static struct cm_pcpu *
+pcpu_mine (void)
+{
+
+	if (!CURCPU_EXISTS()) {
+		return (NULL);
+	}
+	KASSERT(curcpu -> c_number < MAXCPUS);
+	return (&cm_pcpu[curcpu -> c_number]);
 
 }
 
+// Returns this CPU's Cached Frames to the Free List.
 static void
-page_evict (int where)
+pcpu_drain (void)
 {
 
-	DEBUG(DB_VM, "Coremap: page_evict: where = %d\n", where);
+	struct cm_pcpu *pc = NULL;
+	int where;
+
+	pc = pcpu_mine();
+	if (pc == NULL) {
+		return;
+	}
+	KASSERT(curthread -> t_curspl > 0);
 
-	(void)where;
+	while (pc -> count > 0) {
+		where = pc -> frames[--pc -> count];
+		coremap[where].cached = 0;
+		freelist_add(where);
+	}
+	while (pc -> zcount > 0) {
+		where = pc -> zframes[--pc -> zcount];
+		coremap[where].cached = 0;
+		freelist_add(where);
+	}
 
 }
 
-static int
-kernel_maxed (int pagesneeded)
+// Moves a Batch of Frames from the Free List into a CPU's Cache.
+static void
+pcpu_refill (struct cm_pcpu *pc)
 {
 
-	uint32_t npages;
+	int where;
 
-	npages = cm_kernpages + pagesneeded;
-	if (npages >= cm_entries - CM_MIN_SLACK) {
-		return (1);
+	while (pc -> count < CM_PCPU_BATCH) {
+		where = freelist_pop();
+		if (where < 0) {
+			break;
+		}
+		coremap[where].cached = 1;
+		pc -> frames[pc -> count++] = where;
 	}
-	return (0);
 
 }
 
+// Gets a Free Frame, from this CPU's Cache if Possible.
+// - with zero set, a frame from the zeroed pool is preferred, and
+//   *zeroed says whether we got one
+// - zeroed frames are only used for other things once the cache and
+//   the list are empty
+// - frames a stale cm_pin is holding are dropped; cm_unpin returns them
+// - returns -1 if there are no free frames to be had without evicting
 static int
-page_replace (void)
+frame_get (int zero, int *zeroed)
 {
 
+	struct cm_pcpu *pc = NULL;
 	int where;
 
-	DEBUG(DB_VM, "Coremap: page_replace\n");
+	KASSERT(curthread == NULL || curthread -> t_curspl > 0);
 
-	KASSERT(curthread -> t_curspl > 0);
-	KASSERT(lock_do_i_hold(paging_lock));
+	pc = pcpu_mine();
+	*zeroed = 0;
+
+	while (1) {
+
+		if (pc == NULL) {
+			where = freelist_pop();
+		}
+		else {
+			if (!zero || pc -> zcount == 0) {
+				if (pc -> count == 0) {
+					pcpu_refill(pc);
+				}
+			}
+			if ((zero || pc -> count == 0) && pc -> zcount > 0) {
+				where = pc -> zframes[--pc -> zcount];
+				*zeroed = 1;
+			}
+			else if (pc -> count > 0) {
+				where = pc -> frames[--pc -> count];
+				*zeroed = 0;
+			}
+			else {
+				*zeroed = 0;
+				return (-1);
+			}
+			KASSERT(coremap[where].cached);
+			coremap[where].cached = 0;
+		}
 
-	where = find_page_replace();
+		if (where < 0 || !coremap[where].pinned) {
+			return (where);
+		}
 
-	KASSERT(coremap[where].pinned == 0);
-	KASSERT(coremap[where].kernel == 0);
+	}
 
-	if (coremap[where].allocated) {
-		KASSERT(coremap[where].lpage != NULL);
-		KASSERT(!(curthread -> t_in_interrupt));
-		page_evict(where);
+}
+
+// Returns a Frame that just became Free to the Pool.
+// - recently used frames go to this CPU's cache while there is room
+// - does nothing if the frame is pinned, reserved, or already pooled
+static void
+frame_put (unsigned where)
+{
+
+	struct cm_pcpu *pc = NULL;
+
+	KASSERT(where < cm_entries);
+
+	if (coremap[where].allocated || coremap[where].pinned ||
+	    coremap[where].onlist || coremap[where].cached ||
+	    coremap[where].reserved) {
+		return;
 	}
 
-	return (where);
+	pc = pcpu_mine();
+	if (pc != NULL && pc -> count < CM_PCPU_MAX) {
+		coremap[where].cached = 1;
+		pc -> frames[pc -> count++] = where;
+		return;
+	}
+	freelist_add(where);
 
 }
 
+// Counts Frames going from Free to Allocated (delta 1) or back (-1).
+// - before the cpu structures exist only the boot cpu runs, and it
+//   uses slot 0 as it will afterwards
 static void
-mark_allocated (int pos, int pin, int iskern)
+count_frames (int iskern, int delta)
 {
 
-	if (curthread != NULL) {
-		DEBUG(DB_VM, "Coremap: mark_allocated: pos = %d, pin = %d, iskern = %d\n",
-			pos, pin, iskern);
+	struct cm_pcpu *pc = NULL;
+
+	KASSERT(curthread == NULL || curthread -> t_curspl > 0);
+
+	pc = pcpu_mine();
+	if (pc == NULL) {
+		pc = &cm_pcpu[0];
 	}
-		
-	KASSERT(coremap[pos].pinned == 0);
-	KASSERT(coremap[pos].allocated == 0);
-	KASSERT(coremap[pos].kernel == 0);
-	KASSERT(coremap[pos].lpage == NULL);
 
-	if (pin) { coremap[pos].pinned = 1; }
-	coremap[pos].allocated = 1;
-	if (iskern) { coremap[pos].kernel = 1; }
+	if (iskern) { pc -> kernpages += delta; }
+	else { pc -> userpages += delta; }
+	pc -> freepages -= delta;
+	KASSERT(pc -> kernpages + pc -> userpages + pc -> freepages == 0);
+
+}
 
-	if (iskern) { cm_kernpages++; }
-	else { cm_userpages++; }
+// Sums every CPU's Frame Counts.
+// - without a lock the sum can be a little stale, which is fine for
+//   the watermarks and statistics it feeds
+static void
+count_sum (unsigned *kern, unsigned *user, unsigned *free)
+{
+
+	int k; int u; int f;
+	unsigned i;
+
+	k = 0;
+	u = 0;
+	f = 0;
+	for (i = 0; i < MAXCPUS; i++) {
+		k += cm_pcpu[i].kernpages;
+		u += cm_pcpu[i].userpages;
+		f += cm_pcpu[i].freepages;
+	}
+	f += cm_entries;
 
-	cm_freepages--;
-	KASSERT(cm_kernpages + cm_userpages + cm_freepages == cm_entries);
+	// a torn read may come out slightly negative
+	*kern = (k > 0) ? (unsigned)k : 0;
+	*user = (u > 0) ? (unsigned)u : 0;
+	*free = (f > 0) ? (unsigned)f : 0;
 
 }
 
-static paddr_t
-allocate_page (struct lpage *lp, int dopin)
+// Gets the Number of Free Frames.
+static unsigned
+count_free (void)
+{
+
+	unsigned kern; unsigned user; unsigned free;
+
+	count_sum(&kern, &user, &free);
+	return (free);
+
+}
+
+///// Memory Allocation /////
+
+// Checks if a Frame may be Evicted.
+static int
+page_evictable (unsigned where)
+{
+
+	return (coremap[where].allocated &&
+		!coremap[where].kernel &&
+		!coremap[where].pinned);
+
+}
+
+// Pins a User Frame Picked without a Lock.
+// - a fault on another cpu may have pinned it, or even freed it, since
+//   we looked; once we hold the pin it can't change hands
+// - returns 0, leaving the frame alone, if it is no longer ours to take
+static int
+frame_pinuser (unsigned where)
+{
+
+	if (!frame_trypin(where)) {
+		return (0);
+	}
+	if (!coremap[where].allocated || coremap[where].kernel) {
+		cm_unpin(COREMAP_TO_PADDR(where));
+		return (0);
+	}
+	return (1);
+
+}
+
+// Picks a Victim Frame with the Clock Algorithm.
+// - a frame that was faulted on since the last sweep, or that is still
+//   live in the TLB, gets a second chance
+// - returns -1 if every user frame is pinned
+static int
+find_page_replace (void)
 {
 
-	int pos; int iskern; int i;
+	unsigned where; unsigned i;
+
+	DEBUG(DB_VM, "Coremap: find_page_replace\n");
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	// two full turns always find an unreferenced frame unless
+	// everything left is mapped in the TLB
+	for (i = 0; i < 2 * cm_entries; i++) {
+
+		where = cm_clockhand;
+		cm_clockhand = (cm_clockhand + 1) % cm_entries;
+
+		if (!page_evictable(where)) {
+			continue;
+		}
+		if (coremap[where].referenced) {
+			coremap[where].referenced = 0;
+			continue;
+		}
+		if (coremap[where].tlbindex >= 0) {
+			continue;
+		}
+
+		return (where);
+
+	}
+
+	// settle for any user frame that isn't pinned
+	for (i = 0; i < cm_entries; i++) {
+
+		where = cm_clockhand;
+		cm_clockhand = (cm_clockhand + 1) % cm_entries;
+
+		if (page_evictable(where)) {
+			return (where);
+		}
+
+	}
+
+	return (-1);
+
+}
+
+// Evicts the User Page in a Frame.
+// - the frame is pinned while its contents go out, then freed
+// - the frame is not put back in the pool; the caller takes it or
+//   hands it to frame_put
+// - returns ENOSPC if the page has no swap slot and none is left; the
+//   frame stays allocated and counts as referenced, so the clock
+//   moves on to another
+// - returns EBUSY if another cpu pinned or freed it first
+static int
+page_evict (int where)
+{
+
+	struct lpage *lp = NULL;
+	int result;
+
+	DEBUG(DB_VM, "Coremap: page_evict: where = %d\n", where);
+
+	KASSERT(curthread -> t_curspl > 0);
+	KASSERT(lock_do_i_hold(paging_lock));
+
+	if (!frame_pinuser(where)) {
+		return (EBUSY);
+	}
+
+	lp = coremap[where].lpage;
+	KASSERT(lp != NULL);
+
+	tlb_unmap_paddr(COREMAP_TO_PADDR(where));
+	tlb_restoreasid();
+
+	result = lp_evict(lp);
+	if (result) {
+		coremap[where].referenced = 1;
+		cm_unpin(COREMAP_TO_PADDR(where));
+		return (result);
+	}
+
+	KASSERT(coremap[where].pinned);
+	KASSERT(coremap[where].lpage == lp);
+
+	coremap[where].referenced = 0;
+	coremap[where].allocated = 0;
+	coremap[where].lpage = NULL;
+
+	count_frames(0, -1);
+
+	// anyone waiting on the old page will notice it moved
+	frame_unpin(where);
+
+	return (0);
+
+}
+
+static int
+kernel_maxed (int pagesneeded)
+{
+
+	unsigned kern; unsigned user; unsigned free;
+	uint32_t npages;
+
+	count_sum(&kern, &user, &free);
+	npages = kern + pagesneeded;
+	if (npages >= cm_entries - CM_MIN_SLACK) {
+		return (1);
+	}
+	return (0);
+
+}
+
+// Evicts some User Page to Free a Frame.
+// - with swap overcommitted, pages that have no slot may not go out;
+//   clean ones that already have a slot still can
+// - returns -1 if nothing could be evicted
+static int
+page_replace (void)
+{
+
+	unsigned tries;
+	int where;
+
+	DEBUG(DB_VM, "Coremap: page_replace\n");
+
+	KASSERT(curthread -> t_curspl > 0);
+	KASSERT(lock_do_i_hold(paging_lock));
+
+	for (tries = 0; tries < cm_entries; tries++) {
+
+		where = find_page_replace();
+		if (where < 0) {
+			return (-1);
+		}
+
+		KASSERT(!(curthread -> t_in_interrupt));
+
+		if (page_evict(where) == 0) {
+			KASSERT(!coremap[where].allocated);
+			return (where);
+		}
+
+	}
+
+	return (-1);
+
+}
+
+static void
+mark_allocated (int pos, int pin, int iskern)
+{
+
+	if (curthread != NULL) {
+		DEBUG(DB_VM, "Coremap: mark_allocated: pos = %d, pin = %d, iskern = %d\n",
+			pos, pin, iskern);
+	}
+		
+	KASSERT(coremap[pos].pinned == 0);
+	KASSERT(coremap[pos].allocated == 0);
+	KASSERT(coremap[pos].kernel == 0);
+	KASSERT(coremap[pos].lpage == NULL);
+	KASSERT(!coremap[pos].onlist && !coremap[pos].cached);
+	KASSERT(!coremap[pos].reserved);
+
+	if (pin && !frame_trypin(pos)) {
+		panic("mark_allocated: free frame %d is pinned\n", pos);
+	}
+	coremap[pos].allocated = 1;
+	if (iskern) { coremap[pos].kernel = 1; }
+
+	count_frames(iskern, 1);
+
+}
+
+// Allocates a Frame.
+// - the common case takes a frame from this CPU's cache without any
+//   lock; paging_lock is only needed to evict or to wake the daemon
+// - with zero set the frame comes back zero-filled, from the zeroed
+//   pool if it has one
+static paddr_t
+allocate_page (struct lpage *lp, int dopin, int zero)
+{
+
+	int pos; int iskern; int spl;
+	int canevict; int locked; int zeroed;
+
+	if (curthread != NULL) {
+		DEBUG(DB_VM, "Coremap: allocate_page: dopin = %d\n", dopin);
+	}
+
+	iskern = (lp == NULL);
+	canevict = (curthread != NULL && !(curthread -> t_in_interrupt));
+	locked = 0;
+
+	// the frame must stay ours while we zero it
+	KASSERT(!zero || dopin);
+
+	spl = splhigh();
+
+	if (iskern && kernel_maxed(1)) {
+		splx(spl);
+		return (INVALID_PADDR);
+	}
+
+	pos = frame_get(zero, &zeroed);
+
+	if (pos < 0 && canevict) {
+		splx(spl);
+		lock_acquire(paging_lock);
+		locked = 1;
+		spl = splhigh();
+
+		// someone may have freed a frame while we waited
+		pos = frame_get(zero, &zeroed);
+		if (pos < 0) {
+			pos = page_replace();
+			zeroed = 0;
+		}
+	}
+
+	if (pos < 0) {
+		splx(spl);
+		if (locked) {
+			lock_release(paging_lock);
+		}
+		return (INVALID_PADDR);
+	}
+
+	mark_allocated(pos, dopin, iskern);
+	coremap[pos].lpage = lp;
+
+	// ensure free page not in TLB
+	KASSERT(coremap[pos].tlbindex < 0);
+
+	// get the daemon going before we run dry
+	if (canevict && cm_pageout_cv != NULL && count_free() < cm_lowater) {
+		if (!locked) {
+			lock_acquire(paging_lock);
+			locked = 1;
+		}
+		cv_signal(cm_pageout_cv, paging_lock);
+	}
+
+	if (zero && zeroed) {
+		cm_stat_zerohits[curcpu -> c_number]++;
+	}
+	else if (zero) {
+		cm_stat_zeromisses[curcpu -> c_number]++;
+	}
+
+	splx(spl);
+	if (locked) {
+		lock_release(paging_lock);
+	}
+
+	if (zero && !zeroed) {
+		bzero((char *)PADDR_TO_KVADDR(COREMAP_TO_PADDR(pos)), PAGE_SIZE);
+	}
+
+	return (COREMAP_TO_PADDR(pos));
+
+}
+
+///// Contiguous Kernel Runs /////
+
+// Checks if a Frame can become Part of a Kernel Run.
+// - free frames on the list always can (cached ones belong to a cpu);
+//   unpinned user frames can if we may move them
+static int
+page_runnable (unsigned where, int canmove)
+{
+
+	if (!coremap[where].allocated) {
+		return (coremap[where].onlist && !coremap[where].pinned);
+	}
+	return (canmove && page_evictable(where));
+
+}
+
+// Finds the Run of npages Frames needing the fewest User Pages Moved.
+// - one pass, keeping a sliding window over each stretch of usable frames
+// - the flags are read without cm_freelock, so the answer is only a
+//   hint; run_reserve checks each free frame again
+// - returns -1 if no such run exists
+static int
+find_run (unsigned npages, int canmove)
+{
+
+	unsigned i; unsigned len; unsigned cost; unsigned bestcost;
+	int best;
+
+	KASSERT(curthread -> t_curspl > 0);
+	KASSERT(npages > 0);
+
+	best = -1;
+	bestcost = npages + 1;
+	len = 0;
+	cost = 0;
+
+	for (i = 0; i < cm_entries; i++) {
+
+		if (!page_runnable(i, canmove)) {
+			len = 0;
+			cost = 0;
+			continue;
+		}
+
+		len++;
+		cost += coremap[i].allocated;
+		if (len > npages) {
+			cost -= coremap[i - npages].allocated;
+			len = npages;
+		}
+
+		if (len == npages && cost < bestcost) {
+			best = i - npages + 1;
+			bestcost = cost;
+			if (cost == 0) {
+				break;
+			}
+		}
+
+	}
+
+	return (best);
+
+}
+
+// Reserves a Free Frame for a Run being Assembled.
+// - find_run looks without cm_freelock, so the frame may have gone to
+//   another cpu's cache or been allocated since; returns 0 if so
+static int
+run_reserve (unsigned where)
+{
+
+	KASSERT(!coremap[where].reserved);
+
+	if (!freelist_remove(where)) {
+		return (0);
+	}
+	KASSERT(!coremap[where].cached);
+	coremap[where].reserved = 1;
+
+	return (1);
+
+}
+
+// Empties a User Frame inside a Run being Assembled.
+// - the page is copied to a free frame outside [lo, hi) when there is
+//   one, and evicted otherwise
+// - the emptied frame is left reserved so nobody else allocates it
+// - returns ENOSPC if it had to be evicted and swap is full
+// - returns EBUSY if another cpu pinned or freed it first
+static int
+page_relocate (unsigned where, unsigned lo, unsigned hi)
+{
+
+	struct lpage *lp = NULL;
+	int to; int result;
+
+	DEBUG(DB_VM, "Coremap: page_relocate: where = %u\n", where);
+
+	KASSERT(curthread -> t_curspl > 0);
+	KASSERT(lock_do_i_hold(paging_lock));
+	KASSERT(where >= lo && where < hi);
+
+	if (!frame_pinuser(where)) {
+		return (EBUSY);
+	}
+
+	lp = coremap[where].lpage;
+	KASSERT(lp != NULL);
+
+	tlb_unmap_paddr(COREMAP_TO_PADDR(where));
+	tlb_restoreasid();
+
+	// frames freed inside the run while we slept are ours anyway
+	while ((to = freelist_pop()) >= 0) {
+		if (coremap[to].pinned) {
+			continue;
+		}
+		if ((unsigned)to < lo || (unsigned)to >= hi) {
+			break;
+		}
+		coremap[to].reserved = 1;
+	}
+
+	if (to >= 0) {
+		mark_allocated(to, 1, 0);
+		coremap[to].lpage = lp;
+		coremap[to].referenced = coremap[where].referenced;
+		lp_move(lp, COREMAP_TO_PADDR(to));
+		frame_unpin(to);
+	}
+	else {
+		result = lp_evict(lp);
+		if (result) {
+			cm_unpin(COREMAP_TO_PADDR(where));
+			return (result);
+		}
+	}
+
+	KASSERT(coremap[where].pinned);
+	KASSERT(coremap[where].lpage == lp);
+
+	coremap[where].referenced = 0;
+	coremap[where].allocated = 0;
+	coremap[where].lpage = NULL;
+	coremap[where].reserved = 1;
+
+	count_frames(0, -1);
+
+	// anyone waiting on the old page will notice it moved
+	frame_unpin(where);
+
+	return (0);
+
+}
+
+// Releases the Free Frames Reserved for a Run.
+static void
+run_unreserve (unsigned lo, unsigned hi)
+{
+
+	unsigned i;
+
+	for (i = lo; i < hi; i++) {
+		if (coremap[i].reserved) {
+			coremap[i].reserved = 0;
+			frame_put(i);
+		}
+	}
+
+}
+
+// Allocates npages Physically Contiguous Kernel Frames.
+// - free frames in the chosen run are reserved, then the user pages in
+//   it are moved out; pages get pinned by faults while we sleep, so a
+//   run that goes bad is given up and rescanned
+static paddr_t
+allocate_run (unsigned npages)
+{
+
+	unsigned start; unsigned i; unsigned tries;
+	int where; int spl; int canevict; int ok;
+	paddr_t pa;
+
+	if (curthread != NULL) {
+		DEBUG(DB_VM, "Coremap: allocate_run: npages = %u\n", npages);
+	}
+
+	KASSERT(npages > 1);
+
+	canevict = (curthread != NULL && !(curthread -> t_in_interrupt));
+
+	if (canevict) {
+		lock_acquire(paging_lock);
+	}
+
+	spl = splhigh();
+
+	if (kernel_maxed(npages)) {
+		splx(spl);
+		if (canevict) {
+			lock_release(paging_lock);
+		}
+		return (INVALID_PADDR);
+	}
+
+	pa = INVALID_PADDR;
+	// cached frames are invisible to find_run
+	pcpu_drain();
+
+	for (tries = 0; tries < CM_RUN_TRIES; tries++) {
+
+		where = find_run(npages, canevict);
+		if (where < 0) {
+			break;
+		}
+		start = where;
+
+		// a frame another cpu took since find_run looked means
+		// the run is no good
+		ok = 1;
+		for (i = start; i < start + npages && ok; i++) {
+			if (!coremap[i].allocated && !run_reserve(i)) {
+				ok = 0;
+			}
+		}
+
+		for (i = start; i < start + npages && ok; i++) {
+			if (coremap[i].reserved) {
+				continue;
+			}
+			if (!coremap[i].allocated) {
+				// freed while we slept
+				if (!run_reserve(i)) {
+					ok = 0;
+				}
+				continue;
+			}
+			if (!page_evictable(i)) {
+				ok = 0;
+				continue;
+			}
+			if (page_relocate(i, start, start + npages)) {
+				ok = 0;
+			}
+		}
+
+		// a stale cm_pin may have caught a reserved frame
+		for (i = start; i < start + npages && ok; i++) {
+			if (coremap[i].pinned) {
+				ok = 0;
+			}
+		}
+
+		if (!ok) {
+			run_unreserve(start, start + npages);
+			continue;
+		}
+
+		for (i = start; i < start + npages; i++) {
+			coremap[i].reserved = 0;
+			mark_allocated(i, 0, 1);
+			coremap[i].notlast = (i != start + npages - 1);
+			frame_wake(i);
+		}
+		pa = COREMAP_TO_PADDR(start);
+		break;
+
+	}
+
+	if (canevict && cm_pageout_cv != NULL && count_free() < cm_lowater) {
+		cv_signal(cm_pageout_cv, paging_lock);
+	}
+
+	splx(spl);
+	if (canevict) {
+		lock_release(paging_lock);
+	}
+
+	return (pa);
+
+}
+
+///// Pageout Daemon /////
+
+// Writes Dirty Pages Ahead of the Clock Hand.
+// - only frames that would be evicted soon (unreferenced and not in
+//   the TLB) are worth the I/O
+// - each frame is pinned while it is written, so the evictor and the
+//   fault path leave it alone
+static void
+pageout_clean (void)
+{
+
+	struct lpage *lp = NULL;
+	unsigned where; unsigned i; unsigned ncleaned;
+	int spl;
+
+	ncleaned = 0;
+	where = cm_clockhand;
+
+	for (i = 0; i < cm_entries && ncleaned < cm_hiwater; i++) {
+
+		where = (where + 1) % cm_entries;
+
+		spl = splhigh();
+		if (!page_evictable(where) || coremap[where].referenced ||
+		    coremap[where].tlbindex >= 0 || !frame_pinuser(where)) {
+			splx(spl);
+			continue;
+		}
+		lp = coremap[where].lpage;
+		KASSERT(lp != NULL);
+		// no stale writable mapping may survive the clean
+		tlb_unmap_paddr(COREMAP_TO_PADDR(where));
+		tlb_restoreasid();
+		splx(spl);
+
+		if (lp_clean(lp)) {
+			ncleaned++;
+		}
+
+		cm_unpin(COREMAP_TO_PADDR(where));
+
+	}
+
+}
+
+// Keeps the Free Frame Count between the Watermarks.
+static void
+pageout_thread (void *junk1, unsigned long junk2)
+{
+
+	int where; int spl; int result;
+	unsigned nfree;
+
+	(void)junk1;
+	(void)junk2;
+
+	while (1) {
+
+		lock_acquire(paging_lock);
+		while (count_free() >= cm_lowater) {
+			cv_wait(cm_pageout_cv, paging_lock);
+		}
+		lock_release(paging_lock);
+
+		// clean file system buffers go before anyone's pages
+		nfree = count_free();
+		DEBUG(DB_VM, "Coremap: pageout: %u free\n", nfree);
+
+		if (nfree < cm_hiwater && buf_reclaim(cm_hiwater - nfree) > 0) {
+			continue;
+		}
+
+		// free one frame at a time so faulting threads get in
+		while (1) {
+
+			lock_acquire(paging_lock);
+			spl = splhigh();
+
+			if (count_free() >= cm_hiwater) {
+				splx(spl);
+				lock_release(paging_lock);
+				break;
+			}
+
+			where = find_page_replace();
+			result = (where < 0) ? ENOMEM : page_evict(where);
+			if (result) {
+				splx(spl);
+				lock_release(paging_lock);
+				if (result == EBUSY) {
+					// a fault got to it first
+					continue;
+				}
+				break;
+			}
+			frame_put(where);
+
+			splx(spl);
+			lock_release(paging_lock);
+
+		}
+
+		pageout_clean();
+
+	}
+
+}
+
+// Starts the Pageout Daemon.
+// - must be called after swap_bootstrap
+void
+pageout_bootstrap (void)
+{
+
+	int result;
+
+	DEBUG(DB_VM, "Coremap: pageout_bootstrap\n");
+
+	cm_pageout_cv = cv_create("pageout");
+	if (cm_pageout_cv == NULL) {
+		panic("pageout_bootstrap: Out of memory\n");
+	}
+
+	result = thread_fork("pageout", pageout_thread, NULL, 0, NULL);
+	if (result) {
+		panic("pageout_bootstrap: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+
+}
+
+// Allocates User-Level Page.
+paddr_t
+cm_allocuserpage (struct lpage *lp)
+{
+
+	if (curthread != NULL) {
+		DEBUG(DB_VM, "Coremap: cm_allocuserpage\n");
+	}
+
+	KASSERT(!(curthread -> t_in_interrupt));
+	return (allocate_page(lp, 1, 0));
+
+}
+
+// Allocates a Zero-Filled User-Level Page.
+// - takes a frame zeroed while idle if this cpu has one
+paddr_t
+cm_allocuserzero (struct lpage *lp)
+{
+
+	if (curthread != NULL) {
+		DEBUG(DB_VM, "Coremap: cm_allocuserzero\n");
+	}
+
+	KASSERT(!(curthread -> t_in_interrupt));
+	return (allocate_page(lp, 1, 1));
+
+}
+
+// Zeroes one Free Frame for this CPU's Zeroed Pool.
+// - called from the idle loop with interrupts off, a page at a time,
+//   so a wakeup is never kept waiting for more than one bzero
+// - returns 0 once the pool is full or there is nothing free to zero
+int
+cm_zeroidle (void)
+{
+
+	struct cm_pcpu *pc = NULL;
+	int where;
+
+	KASSERT(curthread -> t_curspl > 0);
 
-	if (curthread != NULL) {
-		DEBUG(DB_VM, "Coremap: allocate_page: dopin = %d\n", dopin);
+	pc = pcpu_mine();
+	if (pc == NULL || pc -> zcount >= CM_PCPU_ZERO) {
+		return (0);
 	}
 
-	iskern = (lp == NULL);
-
-	if (curthread != NULL && !(curthread -> t_in_interrupt)) {
-		lock_acquire(paging_lock);
+	// leave the pageout daemon's slack alone
+	if (count_free() <= cm_lowater) {
+		return (0);
 	}
 
-	if (iskern && kernel_maxed(1)) {
-		if (curthread != NULL && !(curthread -> t_in_interrupt)) {
-			lock_release(paging_lock);
+	do {
+		if (pc -> count > 0) {
+			where = pc -> frames[--pc -> count];
+			coremap[where].cached = 0;
 		}
-		return (INVALID_PADDR);
-	}
-
-	pos = -1;
-	if (cm_freepages > 0) {
-		for (i = cm_entries-1; i >= 0; i--) {
-			if (!coremap[i].pinned && !coremap[i].allocated) {
-				KASSERT(coremap[i].kernel == 0);
-				KASSERT(coremap[i].lpage == NULL);
-				pos = i;
-				break;
+		else {
+			where = freelist_pop();
+			if (where < 0) {
+				return (0);
 			}
 		}
-	}
+	} while (coremap[where].pinned);
 
-	if (pos < 0 && !(curthread -> t_in_interrupt)) {
-		KASSERT(cm_freepages == 0);
-		pos = page_replace();
-	}
+	bzero((char *)PADDR_TO_KVADDR(COREMAP_TO_PADDR(where)), PAGE_SIZE);
 
-	if (pos < 0) {
-		if (curthread != NULL && !(curthread -> t_in_interrupt)) {
-			lock_release(paging_lock);
-		}
-		return (INVALID_PADDR);
-	}
+	coremap[where].cached = 1;
+	pc -> zframes[pc -> zcount++] = where;
+	cm_stat_zeroidle[curcpu -> c_number]++;
 
-	mark_allocated(pos, dopin, iskern);
-	coremap[pos].lpage = lp;
+	return (1);
 
-	// ensure free page not in TLB
-	KASSERT(coremap[pos].tlbindex < 0);
+}
 
-	if (curthread != NULL && !(curthread -> t_in_interrupt)) {
-		lock_release(paging_lock);
-	}
+// Counts Frames by what they Hold.
+void
+cm_framecounts (unsigned *kern, unsigned *user, unsigned *free)
+{
 
-	return (COREMAP_TO_PADDR(pos));
+	count_sum(kern, user, free);
 
 }
 
-// Allocates User-Level Page.
-paddr_t
-cm_allocuserpage (struct lpage *lp)
+// Prints Zeroed Pool Statistics.
+void
+cm_printzerostats (void)
 {
 
-	if (curthread != NULL) {
-		DEBUG(DB_VM, "Coremap: cm_allocuserpage\n");
+	uint32_t hits; uint32_t misses; uint32_t idle;
+	unsigned i;
+	int spl;
+
+	hits = 0;
+	misses = 0;
+	idle = 0;
+
+	spl = splhigh();
+	for (i = 0; i < MAXCPUS; i++) {
+		hits += cm_stat_zerohits[i];
+		misses += cm_stat_zeromisses[i];
+		idle += cm_stat_zeroidle[i];
 	}
+	splx(spl);
 
-	KASSERT(!(curthread -> t_in_interrupt));
-	return (allocate_page(lp, 1));
+	kprintf("Zeroed pool: %lu hits, %lu misses, %lu zeroed while idle\n",
+		(unsigned long)hits, (unsigned long)misses,
+		(unsigned long)idle);
 
 }
 
@@ -424,28 +1802,30 @@ cm_deallocpage (paddr_t page, int iskern)
 	KASSERT(ppn < cm_entries);
 	KASSERT(coremap[ppn].allocated);
 
-	// flush tlb mapping
-	if (coremap[ppn].tlbindex >= 0) {
-		tlb_invalidate(coremap[ppn].tlbindex);
-		coremap[ppn].tlbindex = -1;
+	// flush tlb mappings
+	if (!coremap[ppn].kernel) {
+		tlb_unmap_paddr(page);
+		tlb_restoreasid();
 	}
+	KASSERT(coremap[ppn].tlbindex < 0);
 
 	coremap[ppn].allocated = 0;
 	if (coremap[ppn].kernel) {
 		KASSERT(coremap[ppn].lpage == NULL);
 		KASSERT(iskern);
-		cm_kernpages--;
 		coremap[ppn].kernel = 0;
 	}
 	else {
 		KASSERT(coremap[ppn].lpage != NULL);
 		KASSERT(!iskern);
-		cm_userpages--;
 	}
-	cm_freepages++;
+	count_frames(iskern, -1);
 
 	coremap[ppn].lpage = NULL;
 
+	// a pinned frame goes back when it is unpinned
+	frame_put(ppn);
+
 	splx(spl);
 
 }
@@ -462,10 +1842,10 @@ alloc_kpages (int npages)
 	}
 
 	if (npages > 1) {
-		panic("UH OH");
+		pa = allocate_run(npages);
 	}
 	else {
-		pa = allocate_page(NULL, 0);
+		pa = allocate_page(NULL, 0, 0);
 	}
 
 	if (pa == INVALID_PADDR) {
@@ -476,14 +1856,27 @@ alloc_kpages (int npages)
 
 }
 
+// Frees a Kernel Allocation.
+// - a multi-page run is released frame by frame up to its last page
 void 
 free_kpages (vaddr_t addr)
 {
 
+	unsigned ppn; int more;
+
 	if (curthread != NULL) {
 		DEBUG(DB_VM, "Coremap: free_kpages\n");
 	}
-	cm_deallocpage(KVADDR_TO_PADDR(addr), 1);
+
+	ppn = PADDR_TO_COREMAP(KVADDR_TO_PADDR(addr));
+	do {
+		KASSERT(ppn < cm_entries);
+		KASSERT(coremap[ppn].kernel);
+		more = coremap[ppn].notlast;
+		coremap[ppn].notlast = 0;
+		cm_deallocpage(COREMAP_TO_PADDR(ppn), 1);
+		ppn++;
+	} while (more);
 
 }
 
@@ -492,6 +1885,7 @@ void
 cm_pin (paddr_t paddr)
 {
 
+	struct wchan *wc;
 	int spl; unsigned index;
 
 	if (curthread != NULL) {
@@ -500,15 +1894,19 @@ cm_pin (paddr_t paddr)
 	
 	index = PADDR_TO_COREMAP(paddr);
 	KASSERT(index < cm_entries);
+	wc = frame_waitq(index);
 
 	spl = splhigh();
-	if (coremap[index].wchan == NULL) {
-		coremap[index].wchan = wchan_create("lpage");
-	}
+	// check and set holding the channel, so an unpin can't slip past
+	// and no other cpu can pin it too
+	wchan_lock(wc);
 	while (coremap[index].pinned) {
-		wchan_sleep(coremap[index].wchan);
+		vmstat_inc(VMS_PINWAITS);
+		wchan_sleep(wc);
+		wchan_lock(wc);
 	}
 	coremap[index].pinned = 1;
+	wchan_unlock(wc);
 
 	splx(spl);
 
@@ -553,22 +1951,154 @@ cm_unpin (paddr_t paddr)
 	KASSERT(index < cm_entries);
 
 	spl = splhigh();
-	KASSERT(coremap[index].pinned);
-	coremap[index].pinned = 0;
-	wchan_wakeall(coremap[index].wchan);
+	frame_unpin(index);
+	if (!coremap[index].allocated) {
+		frame_put(index);
+	}
 	splx(spl);
 
 }
 
 ///// MMU Control /////
 
-static struct addrspace *lastas = NULL;
+// Gets the ASID an Address Space has in this CPU's TLB.
+// - returns -1 if none of its translations can be in this TLB
+static int
+mmu_localasid (struct addrspace *as)
+{
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	if (as == NULL) {
+		return (-1);
+	}
+	if (as -> as_asidgen != cm_cpuasidgen[curcpu -> c_number]) {
+		return (-1);
+	}
+	return (as -> as_asid);
+
+}
+
+// Shoots a Translation down on the other CPUs that may Hold it.
+// - the target only sees the ASID, never the addrspace itself
+// - inside a batch the wait is put off until mmu_batchend
+static void
+mmu_shootas (struct addrspace *as, vaddr_t va)
+{
+
+	struct tlbshootdown ts;
+	uint32_t others;
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	if (as == NULL) {
+		return;
+	}
+
+	others = as -> as_cpus & ~((uint32_t)1 << curcpu -> c_number);
+	if (others == 0) {
+		return;
+	}
+
+	ts.ts_asid = as -> as_asid;
+	ts.ts_asidgen = as -> as_asidgen;
+	ts.ts_vaddr = va & PAGE_FRAME;
+	ts.ts_paddr = INVALID_PADDR;
+	tlb_shootpost(others, &ts);
+
+	if (as -> as_tlbbatch > 0) {
+		as -> as_tlbwait |= others;
+	}
+	else {
+		tlb_shootwait(others);
+	}
+
+}
+
+// Starts Batching Shootdowns for an Address Space.
+// - mmu_unmap and mmu_protect queue their shootdowns without waiting,
+//   so a target takes the whole batch in one interrupt
+void
+mmu_batchbegin (struct addrspace *as)
+{
+
+	KASSERT(as != NULL);
+	as -> as_tlbbatch++;
+
+}
+
+// Ends a Batch, Waiting for every CPU it Shot Down.
+void
+mmu_batchend (struct addrspace *as)
+{
+
+	uint32_t wait;
+	int spl;
+
+	KASSERT(as != NULL);
+	KASSERT(as -> as_tlbbatch > 0);
+
+	as -> as_tlbbatch--;
+	if (as -> as_tlbbatch > 0) {
+		return;
+	}
+
+	spl = splhigh();
+	wait = as -> as_tlbwait;
+	as -> as_tlbwait = 0;
+	tlb_shootwait(wait);
+	splx(spl);
+
+}
+
+// Handles a Shootdown sent by another CPU.
+// - called from interprocessor_interrupt with interrupts off
+void
+mmu_shootdown (const struct tlbshootdown *ts)
+{
+
+	unsigned me;
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	me = curcpu -> c_number;
+	cm_stat_shootrecv[me]++;
+
+	if (ts -> ts_paddr != INVALID_PADDR) {
+		tlb_purge_paddr(ts -> ts_paddr);
+	}
+	else if (ts -> ts_asidgen == cm_cpuasidgen[me]) {
+		tlb_unmap(ts -> ts_vaddr, ts -> ts_asid);
+	}
+	else if (ts -> ts_asidgen > cm_cpuasidgen[me]) {
+		// we may still run it under the ASID it had before
+		tlb_clear();
+	}
+	tlb_restoreasid();
+
+}
+
+// Handles a Shootdown Queue that Overflowed.
+void
+mmu_shootdown_all (void)
+{
+
+	KASSERT(curthread -> t_curspl > 0);
+
+	cm_stat_shootall[curcpu -> c_number]++;
+	tlb_clear();
+	tlb_restoreasid();
+
+}
 
 // Sets Address Space in MMU.
+// - translations stay in the TLB tagged with their ASID, so switching
+//   back to a recently run address space finds them still warm
 void
 mmu_setas (struct addrspace *as)
 {
 	
+	unsigned me; unsigned asid; unsigned gen;
 	int spl;
 
 	if (curthread != NULL) {
@@ -576,10 +2106,48 @@ mmu_setas (struct addrspace *as)
 	}
 
 	spl = splhigh();
-	if (as != lastas) {
-		lastas = as;
+
+	me = curcpu -> c_number;
+	KASSERT(me < MAXCPUS);
+	cm_cpus[me] = curcpu -> c_self;
+
+	if (as != cm_curas[me]) {
+		cm_curas[me] = as;
+		cm_stat_asswitches++;
+	}
+
+	if (as == NULL) {
+		cm_curasid[me] = ASID_KERNEL;
+		tlb_restoreasid();
+		splx(spl);
+		return;
+	}
+
+	spinlock_acquire(&cm_asidlock);
+	if (as -> as_asidgen != cm_asidgen) {
+		if (cm_nextasid == NUM_ASID) {
+			cm_asidgen++;
+			cm_nextasid = ASID_KERNEL + 1;
+			cm_stat_asidrollovers++;
+		}
+		as -> as_asid = cm_nextasid++;
+		as -> as_asidgen = cm_asidgen;
+		as -> as_cpus = 0;
+	}
+	as -> as_cpus |= (uint32_t)1 << me;
+	asid = as -> as_asid;
+	gen = as -> as_asidgen;
+	spinlock_release(&cm_asidlock);
+
+	// this TLB may hold entries for last generation's owner of asid
+	if (cm_cpuasidgen[me] != gen) {
 		tlb_clear();
+		cm_cpuasidgen[me] = gen;
 	}
+
+	cm_curasid[me] = asid;
+	tlb_restoreasid();
+
 	splx(spl);
 
 }
@@ -589,54 +2157,101 @@ void
 mmu_unmap (struct addrspace *as, vaddr_t va)
 {
 
-	int spl;
+	int spl; int asid;
 
 	if (curthread != NULL) {
 		DEBUG(DB_VM, "Coremap: mmu_unmap\n");
 	}
 
 	spl = splhigh();
-	if (as == lastas) {
-		tlb_unmap(va);
+	asid = mmu_localasid(as);
+	if (asid >= 0) {
+		tlb_unmap(va, asid);
+		tlb_restoreasid();
 	}
+	mmu_shootas(as, va);
 	splx(spl);
 
 }
 
-// Adds a Translation to MMU.
+// Removes every Translation to a Frame, in any Address Space.
+// - the frame must be pinned so it can't be remapped meanwhile
 void
-mmu_map (struct addrspace *as, vaddr_t va, paddr_t pa, int writable)
+mmu_unmappage (paddr_t pa)
+{
+
+	int spl;
+
+	DEBUG(DB_VM, "Coremap: mmu_unmappage\n");
+
+	KASSERT(cm_pageispinned(pa));
+
+	spl = splhigh();
+	tlb_unmap_paddr(pa);
+	tlb_restoreasid();
+	splx(spl);
+
+}
+
+// Makes a Translation in MMU Read-Only.
+// - the next write through it takes a VM_FAULT_READONLY
+void
+mmu_protect (struct addrspace *as, vaddr_t va)
 {
 
-	int spl; int tlbindex;
+	int spl; int i; int asid;
 	uint32_t ehi; uint32_t elo;
-	unsigned cmix;
 
 	if (curthread != NULL) {
-		DEBUG(DB_VM, "Coremap: mmu_map: va = %x, writable = %d\n", va, writable);
+		DEBUG(DB_VM, "Coremap: mmu_protect: va = %x\n", va);
 	}
 
-	KASSERT(as == lastas);
-
-	KASSERT(pa/PAGE_SIZE >= cm_basepage);
-	KASSERT(pa/PAGE_SIZE - cm_basepage < cm_entries);
-	
 	spl = splhigh();
-
-	tlbindex = tlb_probe(va, 0);
-	if (tlbindex < 0) {
-		tlbindex = mipstlb_getslot();
+	asid = mmu_localasid(as);
+	if (asid >= 0) {
+		i = tlb_probe((va & PAGE_FRAME) | (asid << TLBHI_PIDSHIFT), 0);
+		if (i >= 0) {
+			tlb_read(&ehi, &elo, i);
+			if (elo & TLBLO_DIRTY) {
+				tlb_write(ehi, elo & ~TLBLO_DIRTY, i);
+			}
+		}
+		tlb_restoreasid();
 	}
+	// other cpus just drop it; the refill maps it read-only
+	mmu_shootas(as, va);
+	splx(spl);
+
+}
+
+// Loads a Translation into a Chosen TLB Slot.
+// - keeps the frame's tlbindex/tlbcpus hints up to date
+static void
+mmu_load (uint32_t ehi, paddr_t pa, int writable, int tlbindex)
+{
+
+	uint32_t elo;
+	unsigned cmix;
+
+	KASSERT(curthread -> t_curspl > 0);
 	KASSERT(tlbindex >= 0 && tlbindex < NUM_TLB);
 
 	cmix = PADDR_TO_COREMAP(pa);
 	KASSERT(cmix < cm_entries);
 	if (coremap[cmix].tlbindex != tlbindex) {
-		KASSERT(coremap[cmix].tlbindex == -1);
+		if (coremap[cmix].tlbindex >= 0) {
+			// mapped by another address space too
+			coremap[cmix].tlbmulti = 1;
+		}
 		coremap[cmix].tlbindex = tlbindex;
 	}
+	// the index hint is only good for one TLB
+	if (coremap[cmix].tlbcpus & ~((uint32_t)1 << curcpu -> c_number)) {
+		coremap[cmix].tlbmulti = 1;
+	}
+	coremap[cmix].tlbcpus |= (uint32_t)1 << curcpu -> c_number;
+	coremap[cmix].referenced = 1;
 
-	ehi = va & TLBHI_VPAGE;
 	elo = (pa & TLBLO_PPAGE) | TLBLO_VALID;
 	if (writable) {
 		elo |= TLBLO_DIRTY;
@@ -644,6 +2259,205 @@ mmu_map (struct addrspace *as, vaddr_t va, paddr_t pa, int writable)
 
 	tlb_write(ehi, elo, tlbindex);
 
+}
+
+// Finds a TLB Slot Holding Nothing Valid.
+// - returns -1 rather than evicting anything
+static int
+tlb_freeslot (void)
+{
+
+	uint32_t ehi; uint32_t elo;
+	unsigned me; int i;
+
+	me = curcpu -> c_number;
+	if (cm_tlbnext[me] < NUM_TLB) {
+		return (cm_tlbnext[me]++);
+	}
+
+	for (i = 0; i < NUM_TLB; i++) {
+		tlb_read(&ehi, &elo, i);
+		if (!(elo & TLBLO_VALID)) {
+			return (i);
+		}
+	}
+	return (-1);
+
+}
+
+// Adds a Translation to MMU.
+void
+mmu_map (struct addrspace *as, vaddr_t va, paddr_t pa, int writable)
+{
+
+	int spl; int tlbindex; int asid;
+	uint32_t ehi;
+
+	if (curthread != NULL) {
+		DEBUG(DB_VM, "Coremap: mmu_map: va = %x, writable = %d\n", va, writable);
+	}
+
+	KASSERT(pa/PAGE_SIZE >= cm_basepage);
+	KASSERT(pa/PAGE_SIZE - cm_basepage < cm_entries);
+	
+	spl = splhigh();
+
+	KASSERT(as != NULL && as == cm_curas[curcpu -> c_number]);
+	asid = mmu_localasid(as);
+	KASSERT(asid > ASID_KERNEL);
+
+	ehi = (va & TLBHI_VPAGE) | (asid << TLBHI_PIDSHIFT);
+
+	tlbindex = tlb_probe(ehi, 0);
+	if (tlbindex < 0) {
+		tlbindex = mipstlb_getslot();
+		cm_stat_tlbrefills[curcpu -> c_number]++;
+		vmstat_inc(VMS_TLBMISSES);
+	}
+
+	mmu_load(ehi, pa, writable, tlbindex);
+	tlb_restoreasid();
+
+	splx(spl);
+
+}
+
+// Adds a Translation Speculatively, for Fault-Around.
+// - only uses a TLB slot nothing valid is in, so it never costs the
+//   faulting process an entry it already had
+// - returns EEXIST if it is already loaded, ENOSPC once the TLB is full
+int
+mmu_prefault (struct addrspace *as, vaddr_t va, paddr_t pa, int writable)
+{
+
+	int spl; int tlbindex; int asid;
+	uint32_t ehi;
+
+	DEBUG(DB_VM, "Coremap: mmu_prefault: va = %x\n", va);
+
+	KASSERT(pa/PAGE_SIZE >= cm_basepage);
+	KASSERT(pa/PAGE_SIZE - cm_basepage < cm_entries);
+
+	spl = splhigh();
+
+	KASSERT(as != NULL && as == cm_curas[curcpu -> c_number]);
+	asid = mmu_localasid(as);
+	KASSERT(asid > ASID_KERNEL);
+
+	ehi = (va & TLBHI_VPAGE) | (asid << TLBHI_PIDSHIFT);
+
+	// already there; leave its protection alone
+	if (tlb_probe(ehi, 0) >= 0) {
+		tlb_restoreasid();
+		splx(spl);
+		return (EEXIST);
+	}
+
+	tlbindex = tlb_freeslot();
+	if (tlbindex < 0) {
+		tlb_restoreasid();
+		splx(spl);
+		return (ENOSPC);
+	}
+
+	mmu_load(ehi, pa, writable, tlbindex);
+	tlb_restoreasid();
+
+	splx(spl);
+	return (0);
+
+}
+
+// Selects the TLB Replacement Policy by Name.
+// - clears the refill/eviction counters so runs can be compared
+int
+mmu_setpolicy (const char *name)
+{
+
+	unsigned i; unsigned policy;
+	int spl;
+
+	for (policy = 0; policy < NUM_TLBPOLICY; policy++) {
+		if (!strcmp(name, cm_tlbpolicynames[policy])) {
+			break;
+		}
+	}
+	if (policy == NUM_TLBPOLICY) {
+		return (EINVAL);
+	}
+
+	spl = splhigh();
+	cm_tlbpolicy = policy;
+	for (i = 0; i < MAXCPUS; i++) {
+		cm_stat_tlbrefills[i] = 0;
+		cm_stat_tlbevictions[i] = 0;
+	}
+	splx(spl);
+
+	return (0);
+
+}
+
+// Prints TLB Refill Statistics.
+void
+mmu_printstats (void)
+{
+
+	uint32_t refills[MAXCPUS]; uint32_t evictions[MAXCPUS];
+	uint32_t sent[MAXCPUS]; uint32_t recv[MAXCPUS]; uint32_t all[MAXCPUS];
+	uint32_t totrefills; uint32_t totevictions;
+	uint32_t totsent; uint32_t totrecv; uint32_t totall;
+	uint32_t switches; uint32_t flushes; uint32_t rollovers;
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i = 0; i < MAXCPUS; i++) {
+		refills[i] = cm_stat_tlbrefills[i];
+		evictions[i] = cm_stat_tlbevictions[i];
+		sent[i] = cm_stat_shootsent[i];
+		recv[i] = cm_stat_shootrecv[i];
+		all[i] = cm_stat_shootall[i];
+	}
+	switches = cm_stat_asswitches;
+	flushes = cm_stat_tlbflushes;
+	rollovers = cm_stat_asidrollovers;
 	splx(spl);
 
+	totrefills = 0;
+	totevictions = 0;
+	totsent = 0;
+	totrecv = 0;
+	totall = 0;
+	kprintf("TLB policy:             %s\n", cm_tlbpolicynames[cm_tlbpolicy]);
+	for (i = 0; i < MAXCPUS; i++) {
+		// cpus that never took a miss are not worth a line
+		if (i > 0 && refills[i] == 0 && evictions[i] == 0) {
+			continue;
+		}
+		kprintf("cpu%u: misses %lu, evictions %lu, "
+			"shootdowns sent %lu, handled %lu, full %lu\n", i,
+			(unsigned long)refills[i], (unsigned long)evictions[i],
+			(unsigned long)sent[i], (unsigned long)recv[i],
+			(unsigned long)all[i]);
+		totrefills += refills[i];
+		totevictions += evictions[i];
+		totsent += sent[i];
+		totrecv += recv[i];
+		totall += all[i];
+	}
+	kprintf("TLB refills:            %lu\n", (unsigned long)totrefills);
+	kprintf("TLB evictions:          %lu\n", (unsigned long)totevictions);
+	kprintf("Address space switches: %lu\n", (unsigned long)switches);
+	kprintf("Full TLB flushes:       %lu\n", (unsigned long)flushes);
+	kprintf("ASID rollovers:         %lu\n", (unsigned long)rollovers);
+	kprintf("Shootdowns sent:        %lu\n", (unsigned long)totsent);
+	kprintf("Shootdowns handled:     %lu\n", (unsigned long)totrecv);
+	kprintf("Shootdown overflows:    %lu\n", (unsigned long)totall);
+	if (switches > 0) {
+		kprintf("Refills per switch:     %lu.%02lu\n",
+			(unsigned long)(totrefills / switches),
+			(unsigned long)((totrefills % switches) * 100 / switches));
+	}
+
 }
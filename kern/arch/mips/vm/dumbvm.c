@@ -93,6 +93,58 @@ free_kpages(vaddr_t addr)
 	(void)addr;
 }
 
+void
+vm_printtlbstats(void)
+{
+	kprintf("dumbvm: no TLB statistics\n");
+}
+
+void
+vm_printfaultstats(void)
+{
+	kprintf("dumbvm: no fault statistics\n");
+}
+
+int
+vm_idle(void)
+{
+	return 0;
+}
+
+unsigned
+vm_freepages(void)
+{
+	/* dumbvm can't tell, and never gives memory back anyway */
+	return 0;
+}
+
+void
+vm_printvmstat(void)
+{
+	kprintf("dumbvm: no VM statistics\n");
+}
+
+int
+vm_setovercommit(int on)
+{
+	(void)on;
+	return EUNIMP;
+}
+
+int
+vm_setfaultaround(unsigned npages)
+{
+	(void)npages;
+	return EUNIMP;
+}
+
+int
+vm_settlbpolicy(const char *name)
+{
+	(void)name;
+	return EUNIMP;
+}
+
 void
 vm_tlbshootdown_all(void)
 {
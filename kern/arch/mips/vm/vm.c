@@ -8,13 +8,32 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <spl.h>
+#include <clock.h>
 #include <synch.h>
 #include <vm.h>
 #include <machine/coremap.h>
 #include <addrspace.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
+#include <platform/maxcpus.h>
 #include <mainbus.h>
+#include <vmstat.h>
+#include "opt-faulthist.h"
+
+#if OPT_FAULTHIST
+// fault latency histogram
+// - only with "options faulthist": timing costs two gettime calls a
+//   fault, which is a lot next to a TLB refill
+// - bucket i counts faults that took under 2^i microseconds; the last
+//   one takes everything slower
+// - each cpu counts its own faults with interrupts off; printing sums
+//   the cpus
+#define VM_FAULTBUCKETS		16
+
+static uint32_t vm_faulthist[MAXCPUS][VM_FAULTBUCKETS];
+#endif
 
 size_t
 vm_bootstrap (void)
@@ -22,21 +41,180 @@ vm_bootstrap (void)
 
 	cm_bootstrap();
 	paging_lock = lock_create("paging_lock");
+	vmo_bootstrap();
 	return (mainbus_ramsize());
 	
 }
 
+// Prints TLB Statistics.
+void
+vm_printtlbstats (void)
+{
+
+	mmu_printstats();
+
+}
+
+// Selects the TLB Replacement Policy.
+int
+vm_settlbpolicy (const char *name)
+{
+
+	return (mmu_setpolicy(name));
+
+}
+
+// Handles a TLB Shootdown Queue that Overflowed.
 void
 vm_tlbshootdown_all (void)
 {
-	panic("dumbvm tried to do tlb shootdown?!\n");
+
+	mmu_shootdown_all();
+
 }
 
+// Handles one TLB Shootdown from another CPU.
 void
 vm_tlbshootdown (const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
+
+	mmu_shootdown(ts);
+
+}
+
+// Does Background VM Work from the Idle Loop.
+// - returns nonzero if it did something, so the caller looks for a
+//   thread to run again before idling
+int
+vm_idle (void)
+{
+
+	return (cm_zeroidle());
+
+}
+
+// Counts Free Frames.
+unsigned
+vm_freepages (void)
+{
+
+	unsigned kern; unsigned user; unsigned free;
+
+	cm_framecounts(&kern, &user, &free);
+	return (free);
+
+}
+
+// Prints the VM Event Counters and Frame Counts.
+void
+vm_printvmstat (void)
+{
+
+	vmstat_print();
+
+}
+
+// Turns Swap Overcommit On or Off.
+int
+vm_setovercommit (int on)
+{
+
+	swap_setovercommit(on);
+	return (0);
+
+}
+
+// Sets the Fault-Around Window.
+int
+vm_setfaultaround (unsigned npages)
+{
+
+	return (as_setfaultaround(npages));
+
+}
+
+#if OPT_FAULTHIST
+// Counts a Fault that began at secs1/nsecs1 in the Histogram.
+static void
+vm_faulttime (time_t secs1, uint32_t nsecs1)
+{
+
+	time_t secs2, rsecs;
+	uint32_t nsecs2, rnsecs;
+	uint32_t usecs;
+	unsigned bucket;
+	int spl;
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &rsecs, &rnsecs);
+	usecs = rsecs > 0 ? 0xffffffff : rnsecs / 1000;
+	for (bucket = 0; bucket + 1 < VM_FAULTBUCKETS; bucket++) {
+		if (usecs < (1U << bucket)) {
+			break;
+		}
+	}
+
+	spl = splhigh();
+	vm_faulthist[curcpu -> c_number][bucket]++;
+	splx(spl);
+
+}
+
+// Prints the Fault Latency Histogram.
+static void
+vm_printfaulthist (void)
+{
+
+	uint32_t hist[VM_FAULTBUCKETS];
+	uint32_t total;
+	unsigned i; unsigned c;
+
+	// other cpus' counts may move while we add; close enough
+	for (i = 0; i < VM_FAULTBUCKETS; i++) {
+		hist[i] = 0;
+		for (c = 0; c < MAXCPUS; c++) {
+			hist[i] += vm_faulthist[c][i];
+		}
+	}
+
+	total = 0;
+	for (i = 0; i < VM_FAULTBUCKETS; i++) {
+		total += hist[i];
+	}
+
+	kprintf("Fault latency (%lu faults):\n", (unsigned long)total);
+	for (i = 0; i < VM_FAULTBUCKETS; i++) {
+		if (hist[i] == 0) {
+			continue;
+		}
+		if (i + 1 < VM_FAULTBUCKETS) {
+			kprintf("  < %6u us: %lu\n", 1U << i,
+				(unsigned long)hist[i]);
+		}
+		else {
+			kprintf(" >= %6u us: %lu\n", 1U << (i - 1),
+				(unsigned long)hist[i]);
+		}
+	}
+
+}
+#endif
+
+// Prints the Fault Latency Histogram and Fault-Around Statistics.
+void
+vm_printfaultstats (void)
+{
+
+#if OPT_FAULTHIST
+	vm_printfaulthist();
+#else
+	kprintf("Fault latency: not measured (needs options faulthist)\n");
+#endif
+	as_printfaultstats();
+	cm_printzerostats();
+	vmo_printzerostats();
+	swap_printstats();
+
 }
 
 int
@@ -44,6 +222,11 @@ vm_fault (int faulttype, vaddr_t faultaddress)
 {
 
 	struct addrspace *as = NULL;
+#if OPT_FAULTHIST
+	time_t secs;
+	uint32_t nsecs;
+#endif
+	int result;
 
 	faultaddress &= PAGE_FRAME;
 	KASSERT(faultaddress < MIPS_KSEG0);
@@ -53,6 +236,15 @@ vm_fault (int faulttype, vaddr_t faultaddress)
 		return (EFAULT);
 	}
 
-	return (as_fault(as, faulttype, faultaddress));
+#if OPT_FAULTHIST
+	gettime(&secs, &nsecs);
+	result = as_fault(as, faulttype, faultaddress);
+	vm_faulttime(secs, nsecs);
+#else
+	result = as_fault(as, faulttype, faultaddress);
+#endif
+	vmstat_inc(VMS_FAULTS);
+
+	return (result);
 
 }
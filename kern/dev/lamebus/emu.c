@@ -840,10 +840,15 @@ emufs_namefile(struct vnode *v, struct uio *uio)
  */
 static
 int
-emufs_mmap(struct vnode *v)
+emufs_mmap(struct vnode *v, off_t offset, size_t len)
 {
 	(void)v;
-	return EUNIMP;
+	(void)len;
+
+	if (offset < 0) {
+		return EINVAL;
+	}
+	return 0;
 }
 
 //////////////////////////////
@@ -1059,6 +1064,16 @@ emufs_lookparent_notdir(struct vnode *v, char *pathname, struct vnode **result,
 }
 
 
+static
+int
+emufs_mmap_isdir(struct vnode *v, off_t offset, size_t len)
+{
+	(void)v;
+	(void)offset;
+	(void)len;
+	return EISDIR;
+}
+
 static
 int
 emufs_truncate_isdir(struct vnode *v, off_t len)
@@ -1124,7 +1139,7 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_dir_gettype,
 	emufs_dir_tryseek,
 	emufs_void_op_isdir,  /* fsync */
-	emufs_void_op_isdir,  /* mmap */
+	emufs_mmap_isdir,
 	emufs_truncate_isdir,
 	emufs_namefile,
 
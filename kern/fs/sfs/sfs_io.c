@@ -33,75 +33,72 @@
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 
 ////////////////////////////////////////////////////////////
 //
 // Basic block-level I/O routines
 //
+// All I/O goes through the buffer cache, which does the device
+// I/O (and the retrying of errors) for us.
+//
 // Note: sfs_rblock is used to read the superblock
 // early in mount, before sfs is fully (or even mostly)
 // initialized, and so may not use anything from sfs
 // except sfs_device.
 
+/*
+ * Get the buffer for a block, reading it in if it isn't cached.
+ */
 int
-sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
+sfs_bread(struct sfs_fs *sfs, uint32_t block, struct buf **ret)
 {
-	int result;
-	int tries=0;
-
-	KASSERT(vfs_biglock_do_i_hold());
-
-	DEBUG(DB_SFS, "sfs: %s %llu\n", 
-	      uio->uio_rw == UIO_READ ? "read" : "write",
-	      uio->uio_offset / SFS_BLOCKSIZE);
+	return buf_read(sfs->sfs_device, block, ret);
+}
 
- retry:
-	result = sfs->sfs_device->d_io(sfs->sfs_device, uio);
-	if (result == EINVAL) {
-		/*
-		 * This means the sector we requested was out of range,
-		 * or the seek address we gave wasn't sector-aligned,
-		 * or a couple of other things that are our fault.
-		 */
-		panic("sfs: d_io returned EINVAL\n");
-	}
-	if (result == EIO) {
-		if (tries == 0) {
-			tries++;
-			kprintf("sfs: block %llu I/O error, retrying\n",
-				uio->uio_offset / SFS_BLOCKSIZE);
-			goto retry;
-		}
-		else if (tries < 10) {
-			tries++;
-			goto retry;
-		}
-		else {
-			kprintf("sfs: block %llu I/O error, giving up after "
-				"%d retries\n",
-				uio->uio_offset / SFS_BLOCKSIZE, tries);
-		}
-	}
-	return result;
+/*
+ * Get the buffer for a block the caller will overwrite completely.
+ */
+int
+sfs_bget(struct sfs_fs *sfs, uint32_t block, struct buf **ret)
+{
+	return buf_get(sfs->sfs_device, block, ret);
 }
 
+/*
+ * Copy a block out of the cache.
+ */
 int
 sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block)
 {
-	struct iovec iov;
-	struct uio ku;
+	struct buf *b;
+	int result;
 
-	SFSUIO(&iov, &ku, data, block, UIO_READ);
-	return sfs_rwblock(sfs, &ku);
+	result = sfs_bread(sfs, block, &b);
+	if (result) {
+		return result;
+	}
+	memcpy(data, buf_data(b), SFS_BLOCKSIZE);
+	buf_release(b);
+	return 0;
 }
 
+/*
+ * Copy a block into the cache. It reaches the disk later.
+ */
 int
 sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block)
 {
-	struct iovec iov;
-	struct uio ku;
+	struct buf *b;
+	int result;
 
-	SFSUIO(&iov, &ku, data, block, UIO_WRITE);
-	return sfs_rwblock(sfs, &ku);
+	result = sfs_bget(sfs, block, &b);
+	if (result) {
+		return result;
+	}
+	memcpy(buf_data(b), data, SFS_BLOCKSIZE);
+	buf_markdirty(b);
+	buf_release(b);
+	return 0;
 }
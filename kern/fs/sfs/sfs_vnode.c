@@ -43,12 +43,21 @@
 #include <synch.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
+#include <vm.h>
 #include <sfs.h>
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 			 struct sfs_vnode **ret);
 
+/* After sfs_bmap */
+static int sfs_emap_toblocks(struct sfs_vnode *sv, uint32_t fileblock,
+			     uint32_t *diskblock);
+
+/* With the vnode ops */
+static int sfs_dotruncate(struct sfs_vnode *sv, off_t len);
+
 ////////////////////////////////////////////////////////////
 //
 // Simple stuff
@@ -58,12 +67,23 @@ static
 int
 sfs_clearblock(struct sfs_fs *sfs, uint32_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
-	return sfs_wblock(sfs, zeros, block);
+	struct buf *b;
+	int result;
+
+	result = sfs_bget(sfs, block, &b);
+	if (result) {
+		return result;
+	}
+	bzero(buf_data(b), SFS_BLOCKSIZE);
+	buf_markdirty(b);
+	buf_release(b);
+	return 0;
 }
 
-/* Write an on-disk inode structure back out to disk. */
+/*
+ * Write an on-disk inode structure back out to disk (that is, to the
+ * buffer cache). Caller holds sv_rwlock for writing.
+ */
 static
 int
 sfs_sync_inode(struct sfs_vnode *sv)
@@ -84,28 +104,210 @@ sfs_sync_inode(struct sfs_vnode *sv)
 // Space allocation
 
 /*
- * Allocate a block.
+ * Blocks set aside after the last one allocated for a file that is
+ * growing sequentially, so files written at the same time don't end
+ * up interleaved block by block. Consecutive blocks need no seek, and
+ * on the lhd no wait for the disk to come around again either.
+ */
+#define SFS_PREALLOC	8
+
+/*
+ * Allocate a block without clearing it, for callers that are about
+ * to overwrite it anyway. The block is the first free one at or after
+ * GOAL. A GOAL of 0 means no preference: carry on from where the last
+ * such allocation left off, so new objects spread over the disk
+ * instead of all crowding in at the front.
  */
 static
 int
-sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
+sfs_balloc_noclear(struct sfs_fs *sfs, uint32_t goal, uint32_t *diskblock)
 {
+	bool usehint = (goal == 0);
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	if (usehint) {
+		goal = sfs->sfs_allochint;
+	}
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
+		lock_release(sfs->sfs_freemaplock);
 		return result;
 	}
+	if (usehint) {
+		sfs->sfs_allochint = *diskblock + 1;
+	}
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 
 	if (*diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: balloc: invalid block %u\n", *diskblock);
 	}
 
+	return 0;
+}
+
+/*
+ * Allocate a block near GOAL (see above).
+ */
+static
+int
+sfs_balloc(struct sfs_fs *sfs, uint32_t goal, uint32_t *diskblock)
+{
+	int result;
+
+	result = sfs_balloc_noclear(sfs, goal, diskblock);
+	if (result) {
+		return result;
+	}
+
 	/* Clear block before returning it */
 	return sfs_clearblock(sfs, *diskblock);
 }
 
+/*
+ * Allocate the free blocks starting at DISKBLOCK, stopping at the
+ * first one in use or after MAXBLOCKS. Returns how many were taken
+ * (possibly 0). The blocks are not cleared.
+ */
+static
+uint32_t
+sfs_bextend(struct sfs_fs *sfs, uint32_t diskblock, uint32_t maxblocks)
+{
+	uint32_t n;
+
+	lock_acquire(sfs->sfs_freemaplock);
+	for (n = 0; n < maxblocks; n++) {
+		if (diskblock + n >= sfs->sfs_super.sp_nblocks ||
+		    bitmap_isset(sfs->sfs_freemap, diskblock + n)) {
+			break;
+		}
+		bitmap_mark(sfs->sfs_freemap, diskblock + n);
+	}
+	if (n > 0) {
+		sfs->sfs_freemapdirty = true;
+	}
+	lock_release(sfs->sfs_freemaplock);
+
+	return n;
+}
+
+/*
+ * Give back the blocks preallocated for a file. This happens whenever
+ * its inode is synced, so the freemap on disk doesn't show them in use
+ * for long. Caller holds sv_rwlock for writing.
+ */
+static
+void
+sfs_prealloc_discard(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t i;
+
+	if (sv->sv_npreallocated == 0) {
+		return;
+	}
+
+	lock_acquire(sfs->sfs_freemaplock);
+	for (i = 0; i < sv->sv_npreallocated; i++) {
+		bitmap_unmark(sfs->sfs_freemap, sv->sv_prealloc + i);
+	}
+	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
+
+	sv->sv_npreallocated = 0;
+}
+
+/*
+ * Pick where file block FILEBLOCK should go: right after the block
+ * allocated last, if the file is being written in order, or else near
+ * the inode. *SEQUENTIAL says whether the file looks to be growing in
+ * order (which it is, too, when writing starts at the beginning).
+ */
+static
+uint32_t
+sfs_bgoal(struct sfs_vnode *sv, uint32_t fileblock, bool *sequential)
+{
+	if (sv->sv_lastdiskblock != 0 &&
+	    fileblock == sv->sv_lastfileblock + 1) {
+		*sequential = true;
+		return sv->sv_lastdiskblock + 1;
+	}
+	*sequential = (fileblock == 0);
+	return sv->sv_ino;
+}
+
+/*
+ * Allocate a block for a file, near GOAL. If SEQUENTIAL, it comes
+ * from the file's preallocated blocks, or if there are none left a
+ * new batch is set aside after it. The block is zeroed if CLEAR is
+ * set. Caller holds sv_rwlock for writing.
+ */
+static
+int
+sfs_balloc_sv(struct sfs_vnode *sv, uint32_t goal, bool sequential,
+	      bool clear, uint32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t block;
+	int result;
+
+	if (sequential && sv->sv_npreallocated > 0) {
+		block = sv->sv_prealloc++;
+		sv->sv_npreallocated--;
+	}
+	else {
+		/* Any blocks set aside are in the wrong place now. */
+		sfs_prealloc_discard(sv);
+
+		result = sfs_balloc_noclear(sfs, goal, &block);
+		if (result) {
+			return result;
+		}
+		if (sequential) {
+			sv->sv_prealloc = block + 1;
+			sv->sv_npreallocated =
+				sfs_bextend(sfs, block + 1, SFS_PREALLOC);
+		}
+	}
+
+	if (clear) {
+		result = sfs_clearblock(sfs, block);
+		if (result) {
+			return result;
+		}
+	}
+
+	*diskblock = block;
+	return 0;
+}
+
+/*
+ * Like sfs_bextend, for growing a run of a file's blocks: uses the
+ * file's preallocated blocks first, if they start at DISKBLOCK.
+ * Caller holds sv_rwlock for writing.
+ */
+static
+uint32_t
+sfs_bextend_sv(struct sfs_vnode *sv, uint32_t diskblock, uint32_t maxblocks)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t n = 0;
+
+	if (sv->sv_npreallocated > 0 && sv->sv_prealloc == diskblock) {
+		n = sv->sv_npreallocated;
+		if (n > maxblocks) {
+			n = maxblocks;
+		}
+		sv->sv_prealloc += n;
+		sv->sv_npreallocated -= n;
+	}
+	if (n < maxblocks) {
+		n += sfs_bextend(sfs, diskblock + n, maxblocks - n);
+	}
+	return n;
+}
+
 /*
  * Free a block.
  */
@@ -113,8 +315,13 @@ static
 void
 sfs_bfree(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	/* Whatever is cached for it need never be written */
+	buf_forget(sfs->sfs_device, diskblock);
+
+	lock_acquire(sfs->sfs_freemaplock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 }
 
 /*
@@ -124,11 +331,18 @@ static
 int
 sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	int ret;
+
 	if (diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: sfs_bused called on out of range block %u\n", 
 		      diskblock);
 	}
-	return bitmap_isset(sfs->sfs_freemap, diskblock);
+
+	lock_acquire(sfs->sfs_freemaplock);
+	ret = bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_release(sfs->sfs_freemaplock);
+
+	return ret;
 }
 
 ////////////////////////////////////////////////////////////
@@ -136,32 +350,197 @@ sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 // Block mapping/inode maintenance
 
 /*
- * Look up the disk block number (from 0 up to the number of blocks on
- * the disk) given a file and the logical block number within that
- * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * Number of file blocks reachable through the single, double, and
+ * triple indirect blocks.
+ */
+#define SFS_NIBLOCKS	SFS_DBPERIDB
+#define SFS_NDIBLOCKS	(SFS_DBPERIDB * SFS_DBPERIDB)
+#define SFS_NTIBLOCKS	(SFS_DBPERIDB * SFS_DBPERIDB * SFS_DBPERIDB)
+
+/* Largest file, in blocks and in bytes */
+#define SFS_MAXFILEBLOCKS \
+	(SFS_NDIRECT + SFS_NIBLOCKS + SFS_NDIBLOCKS + SFS_NTIBLOCKS)
+#define SFS_MAXFILESIZE ((off_t)SFS_MAXFILEBLOCKS * SFS_BLOCKSIZE)
+
+/*
+ * Block mapping for files with extents (SFS_IF_EXTENTS).
+ *
+ * Look up file block FILEBLOCK and hand back in *DISKBLOCK where it
+ * is on disk (0 for a hole), and in *RUNLEN how many file blocks from
+ * it on, up to MAXRUN, are consecutive on disk (or are all hole).
+ *
+ * If DOALLOC is set, a hole is filled in, and the run is made as long
+ * as it can be, up to MAXRUN, by taking the free disk blocks that
+ * follow it. Newly allocated blocks are always at the end of the run;
+ * *NEWBLOCKS says how many there are. They are zeroed only if CLEAR is
+ * set. A file that would need more than SFS_NEXTENTS extents is
+ * converted to a block map, and the block mapped through that (as a
+ * run of one) instead.
+ *
+ * Caller holds sv_rwlock; for writing, if DOALLOC is set.
  */
 static
 int
-sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
-	 uint32_t *diskblock)
+sfs_emap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc, bool clear,
+	 uint32_t maxrun, uint32_t *diskblock, uint32_t *runlen,
+	 uint32_t *newblocks)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_extent *ext = sv->sv_i.sfi_extents;
+	struct sfs_extent *e;
+	uint32_t block, run, limit, got, goal, j;
+	unsigned i, next;
+	bool mapped, sequential;
+	int result;
 
+	KASSERT(maxrun > 0);
+	*newblocks = 0;
+
+	/* Find the first extent that ends past FILEBLOCK. */
+	for (i=0; i<SFS_NEXTENTS && ext[i].sfe_nblocks > 0; i++) {
+		if (fileblock < ext[i].sfe_fileblock + ext[i].sfe_nblocks) {
+			break;
+		}
+	}
+	mapped = (i < SFS_NEXTENTS && ext[i].sfe_nblocks > 0 &&
+		  ext[i].sfe_fileblock <= fileblock);
+
+	/* The run can't go into the next extent after FILEBLOCK's. */
+	next = mapped ? i+1 : i;
+	limit = maxrun;
+	if (next < SFS_NEXTENTS && ext[next].sfe_nblocks > 0 &&
+	    ext[next].sfe_fileblock - fileblock < limit) {
+		limit = ext[next].sfe_fileblock - fileblock;
+	}
+
+	if (mapped) {
+		e = &ext[i];
+		block = e->sfe_diskblock + (fileblock - e->sfe_fileblock);
+		run = e->sfe_fileblock + e->sfe_nblocks - fileblock;
+		if (run > limit) {
+			run = limit;
+		}
+		else if (doalloc && run < limit) {
+			/* Grow the extent to make the run longer. */
+			got = sfs_bextend_sv(sv,
+					     e->sfe_diskblock + e->sfe_nblocks,
+					     limit - run);
+			if (got > 0) {
+				e->sfe_nblocks += got;
+				sv->sv_dirty = true;
+			}
+			run += got;
+			*newblocks = got;
+		}
+	}
+	else if (!doalloc) {
+		/* A hole, and we're only looking. */
+		*diskblock = 0;
+		*runlen = limit;
+		return 0;
+	}
+	else {
+		/*
+		 * A hole to fill in. If it starts where the previous
+		 * extent ends, try to grow that extent into it.
+		 */
+		run = 0;
+		if (i > 0 &&
+		    ext[i-1].sfe_fileblock + ext[i-1].sfe_nblocks == fileblock) {
+			e = &ext[i-1];
+			block = e->sfe_diskblock + e->sfe_nblocks;
+			run = sfs_bextend_sv(sv, block, limit);
+			e->sfe_nblocks += run;
+		}
+
+		if (run == 0 && ext[SFS_NEXTENTS-1].sfe_nblocks > 0) {
+			/* No, and the table is full. Use a block map. */
+			result = sfs_emap_toblocks(sv, fileblock, diskblock);
+			if (result) {
+				return result;
+			}
+			*runlen = 1;
+			*newblocks = 1;
+			return 0;
+		}
+
+		if (run == 0) {
+			/* No; we need a new extent. */
+			goal = sfs_bgoal(sv, fileblock, &sequential);
+			result = sfs_balloc_sv(sv, goal, sequential, false,
+					       &block);
+			if (result) {
+				return result;
+			}
+			run = 1 + sfs_bextend_sv(sv, block + 1, limit - 1);
+
+			/* Insert it at I, keeping the table sorted. */
+			for (j=SFS_NEXTENTS-1; j>i; j--) {
+				ext[j] = ext[j-1];
+			}
+			ext[i].sfe_fileblock = fileblock;
+			ext[i].sfe_diskblock = block;
+			ext[i].sfe_nblocks = run;
+		}
+
+		sv->sv_dirty = true;
+		*newblocks = run;
+	}
+
+	if (*newblocks > 0) {
+		/* Remember where the file is growing to */
+		sv->sv_lastfileblock = fileblock + run - 1;
+		sv->sv_lastdiskblock = block + run - 1;
+	}
+
+	if (clear) {
+		for (j = run - *newblocks; j < run; j++) {
+			result = sfs_clearblock(sfs, block + j);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	if (!sfs_bused(sfs, block)) {
+		panic("sfs: Data block %u (block %u of file %u) marked free\n",
+		      block, fileblock, sv->sv_ino);
+	}
+	*diskblock = block;
+	*runlen = run;
+	return 0;
+}
+
+/*
+ * Block mapping for files without extents: sfs_bmap, below, for
+ * those. If NEWBLOCK is nonzero, a block DOALLOC has to fill in is
+ * set to NEWBLOCK rather than allocated; the indirect blocks needed
+ * to reach it are still allocated.
+ *
+ * The indirect blocks are read through the buffer cache, so walking
+ * the chain for consecutive blocks of a file costs memory lookups,
+ * not disk reads.
+ *
+ * Caller holds sv_rwlock; for writing, if DOALLOC is set.
+ */
+static
+int
+sfs_bmap_blocks(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
+		uint32_t newblock, uint32_t *diskblock)
+{
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *idbuf;
+	uint32_t *iddata;
+	uint32_t *toplevel;
 	uint32_t block;
 	uint32_t idblock;
-	uint32_t idnum, idoff;
+	uint32_t idoff, span, offset;
+	uint32_t goal;
+	bool sequential;
+	int indirection;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(SFS_DBPERIDB * sizeof(uint32_t) == SFS_BLOCKSIZE);
 
 	/*
 	 * If the block we want is one of the direct blocks...
@@ -175,15 +554,23 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		/*
 		 * Do we need to allocate?
 		 */
-		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+		if (block==0 && doalloc && newblock != 0) {
+			block = newblock;
+		}
+		else if (block==0 && doalloc) {
+			goal = sfs_bgoal(sv, fileblock, &sequential);
+			result = sfs_balloc_sv(sv, goal, sequential, true,
+					       &block);
 			if (result) {
 				return result;
 			}
-
+		}
+		if (block != sv->sv_i.sfi_direct[fileblock]) {
 			/* Remember what we allocated; mark inode dirty */
 			sv->sv_i.sfi_direct[fileblock] = block;
 			sv->sv_dirty = true;
+			sv->sv_lastfileblock = fileblock;
+			sv->sv_lastdiskblock = block;
 		}
 
 		/*
@@ -198,27 +585,35 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	}
 
 	/*
-	 * It's not a direct block; it must be in the indirect block.
-	 * Subtract off the number of direct blocks, so FILEBLOCK is
-	 * now the offset into the indirect block space.
-	 */
-
-	fileblock -= SFS_NDIRECT;
-
-	/* Get the indirect block number and offset w/i that indirect block */
-	idnum = fileblock / SFS_DBPERIDB;
-	idoff = fileblock % SFS_DBPERIDB;
-
-	/*
-	 * We only have one indirect block. If the offset we were asked for
-	 * is too large, we can't handle it, so fail.
+	 * It's not a direct block. Work out which indirect tree it's
+	 * in, its offset within that tree, and how many file blocks
+	 * each entry of the tree's top block covers.
 	 */
-	if (idnum > 0) {
+	offset = fileblock - SFS_NDIRECT;
+	if (offset < SFS_NIBLOCKS) {
+		toplevel = &sv->sv_i.sfi_indirect;
+		indirection = 1;
+		span = 1;
+	}
+	else if (offset - SFS_NIBLOCKS < SFS_NDIBLOCKS) {
+		offset -= SFS_NIBLOCKS;
+		toplevel = &sv->sv_i.sfi_dindirect;
+		indirection = 2;
+		span = SFS_NIBLOCKS;
+	}
+	else if (offset - SFS_NIBLOCKS - SFS_NDIBLOCKS < SFS_NTIBLOCKS) {
+		offset -= SFS_NIBLOCKS + SFS_NDIBLOCKS;
+		toplevel = &sv->sv_i.sfi_tindirect;
+		indirection = 3;
+		span = SFS_NDIBLOCKS;
+	}
+	else {
+		/* Past the end of the triple indirect block; too big. */
 		return EFBIG;
 	}
 
-	/* Get the disk block number of the indirect block. */
-	idblock = sv->sv_i.sfi_indirect;
+	/* Get the disk block number of the top indirect block. */
+	idblock = *toplevel;
 
 	if (idblock==0 && !doalloc) {
 		/*
@@ -229,55 +624,86 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		*diskblock = 0;
 		return 0;
 	}
-	else if (idblock==0) {
+
+	/*
+	 * Any blocks we allocate go where the data block should go:
+	 * the indirect blocks just before it.
+	 */
+	goal = sfs_bgoal(sv, fileblock, &sequential);
+
+	if (idblock==0) {
 		/*
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
-		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
+		 * it. Thus, we need to allocate an indirect block.
+		 * (sfs_balloc_sv leaves it zeroed in the buffer cache.)
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		result = sfs_balloc_sv(sv, goal, sequential, true, &idblock);
 		if (result) {
 			return result;
 		}
 
 		/* Remember the block we just allocated */
-		sv->sv_i.sfi_indirect = idblock;
+		*toplevel = idblock;
 
 		/* Mark the inode dirty */
 		sv->sv_dirty = true;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
+
+	/*
+	 * Walk down the tree. Each time around, IDBLOCK is an
+	 * indirect block, each of whose entries covers SPAN file
+	 * blocks, and we fetch the entry for OFFSET from it: the next
+	 * indirect block down or, at the bottom, the data block.
+	 */
+	for (; indirection > 0; indirection--) {
+		/* Load the indirect block */
+		result = sfs_bread(sfs, idblock, &idbuf);
 		if (result) {
 			return result;
 		}
-	}
+		iddata = buf_data(idbuf);
+
+		/* Get the entry out of the indirect block buffer */
+		idoff = offset / span;
+		offset %= span;
+		span /= SFS_DBPERIDB;
+		block = iddata[idoff];
+
+		/* If there's nothing there, allocate something */
+		if (block==0 && doalloc && indirection == 1 &&
+		    newblock != 0) {
+			block = newblock;
+		}
+		else if (block==0 && doalloc) {
+			result = sfs_balloc_sv(sv, goal, sequential, true,
+					       &block);
+			if (result) {
+				buf_release(idbuf);
+				return result;
+			}
+		}
+		if (block != iddata[idoff]) {
+			/* Remember the block we allocated */
+			iddata[idoff] = block;
 
-	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+			/* The indirect block is now dirty */
+			buf_markdirty(idbuf);
 
-	/* If there's no block there, allocate one */
-	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
-		if (result) {
-			return result;
+			if (indirection == 1) {
+				/* It's the data block */
+				sv->sv_lastfileblock = fileblock;
+				sv->sv_lastdiskblock = block;
+			}
 		}
 
-		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+		buf_release(idbuf);
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
+		if (block == 0) {
+			/* A hole; the data block is unallocated */
+			break;
 		}
+		idblock = block;
 	}
 
 	/* Hand back the result and return. */
@@ -289,10 +715,188 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	return 0;
 }
 
+/*
+ * Look up the disk block number (from 0 up to the number of blocks on
+ * the disk) given a file and the logical block number within that
+ * file. If DOALLOC is set, and no such block exists, one will be
+ * allocated, along with any indirect blocks needed to reach it.
+ *
+ * Caller holds sv_rwlock; for writing, if DOALLOC is set.
+ */
+static
+int
+sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
+	 uint32_t *diskblock)
+{
+	if (sv->sv_i.sfi_flags & SFS_IF_EXTENTS) {
+		uint32_t runlen, newblocks;
+
+		return sfs_emap(sv, fileblock, doalloc, true, 1, diskblock,
+				&runlen, &newblocks);
+	}
+	return sfs_bmap_blocks(sv, fileblock, doalloc, 0, diskblock);
+}
+
+/*
+ * Free the indirect blocks, but not the data blocks, of the tree
+ * under IDBLOCK, which is INDIRECTION levels above the data.
+ */
+static
+void
+sfs_free_idtree(struct sfs_fs *sfs, uint32_t idblock, int indirection)
+{
+	struct buf *idbuf;
+	uint32_t *iddata;
+	uint32_t j;
+
+	if (idblock == 0) {
+		return;
+	}
+
+	/* If we can't read it, what's below leaks until sfsck runs */
+	if (indirection > 1 && sfs_bread(sfs, idblock, &idbuf) == 0) {
+		iddata = buf_data(idbuf);
+		for (j=0; j<SFS_DBPERIDB; j++) {
+			sfs_free_idtree(sfs, iddata[j], indirection - 1);
+		}
+		buf_release(idbuf);
+	}
+	sfs_bfree(sfs, idblock);
+}
+
+/*
+ * Convert a file whose extent table is full to a block map, and then
+ * map file block FILEBLOCK through that, allocating it. The data stays
+ * where it is; only the indirect blocks are new. If they can't all be
+ * had, the file is left with its extents as before.
+ *
+ * The block map is built while the extents are still in charge, so
+ * it's never seen half done. Caller holds sv_rwlock for writing.
+ */
+static
+int
+sfs_emap_toblocks(struct sfs_vnode *sv, uint32_t fileblock,
+		  uint32_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_extent *e;
+	uint32_t block, j;
+	unsigned i;
+	int result = 0;
+
+	KASSERT(sv->sv_i.sfi_flags & SFS_IF_EXTENTS);
+
+	for (i=0; i<SFS_NEXTENTS && result == 0; i++) {
+		e = &sv->sv_i.sfi_extents[i];
+		for (j=0; j<e->sfe_nblocks && result == 0; j++) {
+			result = sfs_bmap_blocks(sv, e->sfe_fileblock + j,
+						 true, e->sfe_diskblock + j,
+						 &block);
+			KASSERT(result || block == e->sfe_diskblock + j);
+		}
+	}
+
+	if (result) {
+		/* Back out what we built. */
+		sfs_free_idtree(sfs, sv->sv_i.sfi_indirect, 1);
+		sfs_free_idtree(sfs, sv->sv_i.sfi_dindirect, 2);
+		sfs_free_idtree(sfs, sv->sv_i.sfi_tindirect, 3);
+		sv->sv_i.sfi_indirect = 0;
+		sv->sv_i.sfi_dindirect = 0;
+		sv->sv_i.sfi_tindirect = 0;
+		for (j=0; j<SFS_NDIRECT; j++) {
+			sv->sv_i.sfi_direct[j] = 0;
+		}
+		return result;
+	}
+
+	/* Hand the file over to the block map. */
+	bzero(sv->sv_i.sfi_extents, sizeof(sv->sv_i.sfi_extents));
+	sv->sv_i.sfi_flags &= ~SFS_IF_EXTENTS;
+	sv->sv_dirty = true;
+
+	return sfs_bmap_blocks(sv, fileblock, true, 0, diskblock);
+}
+
 ////////////////////////////////////////////////////////////
 //
 // File-level I/O
 
+/*
+ * Move LEN bytes between UIO and disk block DISKBLOCK, starting
+ * SKIPSTART bytes into the block. If WHOLE, a write covers the whole
+ * block, so there's no need to read it first.
+ *
+ * The block's buffer stays busy while we hold it, and touching user
+ * memory can fault - maybe on an mmap of this very file, needing
+ * this very block. So user data is copied through a bounce buffer,
+ * and user memory is only touched with the buffer released.
+ */
+static
+int
+sfs_blockmove(struct sfs_fs *sfs, uint32_t diskblock, bool whole,
+	      uint32_t skipstart, uint32_t len, struct uio *uio)
+{
+	struct buf *iobuf;
+	char *data, *bounce = NULL;
+	bool user = (uio->uio_segflg != UIO_SYSSPACE);
+	bool iswrite = (uio->uio_rw == UIO_WRITE);
+	int result;
+
+	if (user) {
+		bounce = kmalloc(len);
+		if (bounce == NULL) {
+			return ENOMEM;
+		}
+		if (iswrite) {
+			result = uiomove(bounce, len, uio);
+			if (result) {
+				kfree(bounce);
+				return result;
+			}
+		}
+	}
+
+	if (iswrite && whole) {
+		result = sfs_bget(sfs, diskblock, &iobuf);
+	}
+	else {
+		result = sfs_bread(sfs, diskblock, &iobuf);
+	}
+	if (result) {
+		kfree(bounce);
+		return result;
+	}
+	data = (char *)buf_data(iobuf) + skipstart;
+
+	if (!user) {
+		result = uiomove(data, len, uio);
+	}
+	else if (iswrite) {
+		memcpy(data, bounce, len);
+	}
+	else {
+		memcpy(bounce, data, len);
+	}
+
+	/*
+	 * If it was a write, the buffer is dirty - even if the move
+	 * failed partway, since some of it may have been changed. That
+	 * leaves a mix of old and new data, which is only worth keeping
+	 * if the old data was there.
+	 */
+	if (iswrite && (result == 0 || buf_isvalid(iobuf))) {
+		buf_markdirty(iobuf);
+	}
+	buf_release(iobuf);
+
+	if (user && !iswrite) {
+		result = uiomove(bounce, len, uio);
+	}
+	kfree(bounce);
+	return result;
+}
+
 /*
  * Do I/O to a block of a file that doesn't cover the whole block.  We
  * need to read in the original block first, even if we're writing, so
@@ -308,15 +912,6 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 	uint32_t diskblock;
 	uint32_t fileblock;
@@ -339,109 +934,125 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Now perform the requested operation into/out of the block.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	return sfs_blockmove(sfs, diskblock, false, skipstart, len, uio);
+}
+
+/*
+ * Do I/O (either read or write) of a single whole block.
+ */
+static
+int
+sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	uint32_t diskblock;
+	uint32_t fileblock;
+	int result;
+	int doalloc = (uio->uio_rw==UIO_WRITE);
+
+	/* Get the block number within the file */
+	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
+
+	/* Look up the disk block number */
+	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
 	if (result) {
 		return result;
 	}
 
-	/*
-	 * If it was a write, write back the modified block.
-	 */
-	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+	if (diskblock == 0) {
+		/*
+		 * No block - fill with zeros.
+		 *
+		 * We must be reading, or sfs_bmap would have
+		 * allocated a block for us.
+		 */
+		KASSERT(uio->uio_rw == UIO_READ);
+		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
-	return 0;
+	/*
+	 * A write replaces the whole block, so there is no need to
+	 * read it first.
+	 */
+	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
+	return sfs_blockmove(sfs, diskblock, true, 0, SFS_BLOCKSIZE, uio);
 }
 
 /*
- * Do I/O (either read or write) of a single whole block.
+ * Do I/O of whole blocks of a file with extents, up to MAXBLOCKS of
+ * them: as many as are consecutive on disk, in one transfer that
+ * bypasses the buffer cache. *DONE gets the number of blocks covered.
  */
 static
 int
-sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
+sfs_runio(struct sfs_vnode *sv, struct uio *uio, uint32_t maxblocks,
+	  uint32_t *done)
 {
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-	uint32_t diskblock;
-	uint32_t fileblock;
+	uint32_t diskblock, fileblock, run, newblocks, i;
+	size_t len, extraresid;
 	int result;
 	int doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
 
-	/* Get the block number within the file */
-	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
+	KASSERT(sv->sv_i.sfi_flags & SFS_IF_EXTENTS);
 
-	/* Look up the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	if (maxblocks > BUF_MAXRUN) {
+		maxblocks = BUF_MAXRUN;
+	}
+
+	/* Map the run. New blocks needn't be cleared; we'll write them. */
+	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
+	result = sfs_emap(sv, fileblock, doalloc, false, maxblocks,
+			  &diskblock, &run, &newblocks);
 	if (result) {
 		return result;
 	}
+	KASSERT(run > 0 && run <= maxblocks);
+	*done = run;
+
+	/* Trim the uio to the run for the transfer */
+	len = run * SFS_BLOCKSIZE;
+	KASSERT(uio->uio_resid >= len);
+	extraresid = uio->uio_resid - len;
+	uio->uio_resid = len;
 
 	if (diskblock == 0) {
-		/*
-		 * No block - fill with zeros.
-		 *
-		 * We must be reading, or sfs_bmap would have
-		 * allocated a block for us.
-		 */
+		/* A hole - fill with zeros. */
 		KASSERT(uio->uio_rw == UIO_READ);
-		return uiomovezeros(SFS_BLOCKSIZE, uio);
+		result = uiomovezeros(len, uio);
+	}
+	else if (uio->uio_rw == UIO_READ) {
+		result = buf_readrun(sfs->sfs_device, diskblock, run, uio);
+	}
+	else {
+		result = buf_writerun(sfs->sfs_device, diskblock, run, uio);
+		if (result) {
+			/*
+			 * Don't leave whatever the new blocks held before
+			 * readable through this file.
+			 */
+			for (i = run - newblocks; i < run; i++) {
+				sfs_clearblock(sfs, diskblock + i);
+			}
+		}
 	}
 
-	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
-	 */
-	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
-	
-	result = sfs_rwblock(sfs, uio);
-
-	/*
-	 * Now, restore the original uio_offset and uio_resid and update 
-	 * them by the amount of I/O done.
-	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
-
+	uio->uio_resid += extraresid;
 	return result;
 }
 
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
+ * Caller holds sv_rwlock, for writing if this is a write.
  */
 static
 int
@@ -452,6 +1063,17 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	int result = 0;
 	uint32_t extraresid = 0;
 
+	/*
+	 * If writing, don't go past the largest file a block map can
+	 * hold. An extent table has no limit of its own, but it may
+	 * have to become a block map later, and sfi_size has to be
+	 * able to hold the size either way.
+	 */
+	if (uio->uio_rw == UIO_WRITE &&
+	    uio->uio_offset + uio->uio_resid > SFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+
 	/*
 	 * If reading, check for EOF. If we can read a partial area,
 	 * remember how much extra there was in EXTRARESID so we can
@@ -506,11 +1128,22 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	 */
 	KASSERT(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
-	for (i=0; i<nblocks; i++) {
-		result = sfs_blockio(sv, uio);
+	while (nblocks > 0) {
+		/*
+		 * Files with extents go a run at a time. (Check each
+		 * time: a write can convert the file to a block map.)
+		 */
+		if (sv->sv_i.sfi_flags & SFS_IF_EXTENTS) {
+			result = sfs_runio(sv, uio, nblocks, &i);
+		}
+		else {
+			result = sfs_blockio(sv, uio);
+			i = 1;
+		}
 		if (result) {
 			goto out;
 		}
+		nblocks -= i;
 	}
 
 	/*
@@ -801,7 +1434,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, 0, &ino);
 	if (result) {
 		return result;
 	}
@@ -810,7 +1443,17 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * Now load a vnode for it.
 	 */
 
-	return sfs_loadvnode(sfs, ino, type, ret);
+	result = sfs_loadvnode(sfs, ino, type, ret);
+	if (result) {
+		return result;
+	}
+
+	/* On volumes made for it, new files are mapped by extents. */
+	if (type == SFS_TYPE_FILE &&
+	    (sfs->sfs_super.sp_flags & SFS_SPF_EXTENTS)) {
+		(*ret)->sv_i.sfi_flags |= SFS_IF_EXTENTS;
+	}
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////
@@ -870,13 +1513,16 @@ sfs_opendir(struct vnode *v, int openflags)
  *
  * This function should attempt to avoid returning errors, as handling
  * them usefully is often not possible.
+ *
+ * This only puts the inode in the buffer cache; it reaches the disk
+ * with the file's data, on sync or fsync or when the cache needs the
+ * space.
  */
 static
 int
 sfs_close(struct vnode *v)
 {
-	/* Sync it. */
-	return VOP_FSYNC(v);
+	return sfs_sync_vnode(v);
 }
 
 /*
@@ -893,36 +1539,44 @@ sfs_reclaim(struct vnode *v)
 	unsigned ix, i, num;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_rwlock);
+	lock_acquire(sfs->sfs_vnlock);
 
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it. Holding sfs_vnlock keeps
+	 * sfs_loadvnode from finding it while we decide.
 	 */
+	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
 		/* consume the reference VOP_DECREF gave us */
 		KASSERT(v->vn_refcount>1);
 		v->vn_refcount--;
 
-		vfs_biglock_release();
+		spinlock_release(&v->vn_countlock);
+		lock_release(sfs->sfs_vnlock);
+		rwlock_release_write(sv->sv_rwlock);
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount==0) {
-		result = VOP_TRUNCATE(&sv->sv_v, 0);
+		result = sfs_dotruncate(sv, 0);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_vnlock);
+			rwlock_release_write(sv->sv_rwlock);
 			return result;
 		}
 	}
 
-	/* Sync the inode to disk */
+	/* Give back any preallocated blocks, and sync the inode to disk */
+	sfs_prealloc_discard(sv);
 	result = sfs_sync_inode(sv);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sfs->sfs_vnlock);
+		rwlock_release_write(sv->sv_rwlock);
 		return result;
 	}
 
@@ -950,7 +1604,11 @@ sfs_reclaim(struct vnode *v)
 
 	VOP_CLEANUP(&sv->sv_v);
 
-	vfs_biglock_release();
+	lock_release(sfs->sfs_vnlock);
+
+	/* Nobody can find it now, so nobody can be waiting for it. */
+	rwlock_release_write(sv->sv_rwlock);
+	rwlock_destroy(sv->sv_rwlock);
 
 	/* Release the storage for the vnode structure itself. */
 	kfree(sv);
@@ -959,41 +1617,167 @@ sfs_reclaim(struct vnode *v)
 	return 0;
 }
 
+/*
+ * Largest piece of user I/O staged through a kernel buffer at once:
+ * one maximal buffer run.
+ */
+#define SFS_BOUNCESIZE  (BUF_MAXRUN * SFS_BLOCKSIZE)
+
+/*
+ * Allocate a bounce buffer for user I/O on UIO. *LEN gets its size.
+ */
+static
+void *
+sfs_bounce_alloc(struct uio *uio, size_t *len)
+{
+	*len = uio->uio_resid;
+	if (*len > SFS_BOUNCESIZE) {
+		*len = SFS_BOUNCESIZE;
+	}
+	return kmalloc(*len);
+}
+
 /*
  * Called for read(). sfs_io() does the work.
+ *
+ * sv_rwlock must not be held while touching user memory: the user
+ * buffer may be an unfaulted mmap of this same file (or of another
+ * file whose fault path takes its locks in the opposite order), and
+ * the fault would come back in here for the lock. So user reads are
+ * done into a kernel bounce buffer under the lock, and copied out
+ * after it's dropped.
  */
 static
 int
 sfs_read(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct iovec iov;
+	struct uio kuio;
+	void *bounce;
+	size_t len, got;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	vfs_biglock_acquire();
-	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		rwlock_acquire_read(sv->sv_rwlock);
+		result = sfs_io(sv, uio);
+		rwlock_release_read(sv->sv_rwlock);
+		return result;
+	}
+
+	bounce = sfs_bounce_alloc(uio, &len);
+	if (bounce == NULL) {
+		return ENOMEM;
+	}
+
+	result = 0;
+	while (uio->uio_resid > 0) {
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		uio_kinit(&iov, &kuio, bounce, len, uio->uio_offset,
+			  UIO_READ);
+
+		rwlock_acquire_read(sv->sv_rwlock);
+		result = sfs_io(sv, &kuio);
+		rwlock_release_read(sv->sv_rwlock);
+		if (result) {
+			break;
+		}
+
+		got = len - kuio.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+		result = uiomove(bounce, got, uio);
+		if (result || got < len) {
+			break;
+		}
+	}
 
+	kfree(bounce);
 	return result;
 }
 
 /*
  * Called for write(). sfs_io() does the work.
+ *
+ * As with sfs_read, user data is staged through a kernel bounce
+ * buffer so sv_rwlock is never held across a user fault.
+ *
+ * Pages of the file that are mmapped are brought up to date once the
+ * data is in the file and the lock is dropped (see vmo_filewrite).
+ * Kernel writes skip that: the only ones to files are msync's, which
+ * come from the mapped page itself, and hold its lock.
  */
 static
 int
 sfs_write(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
-	int result;
+	struct iovec iov;
+	struct uio kuio;
+	void *bounce;
+	size_t len;
+	off_t pos;
+	int result, err;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
-	vfs_biglock_acquire();
-	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	if (uio->uio_segflg == UIO_SYSSPACE) {
+		rwlock_acquire_write(sv->sv_rwlock);
+		result = sfs_io(sv, uio);
+		rwlock_release_write(sv->sv_rwlock);
+		return result;
+	}
+
+	/* sfs_io checks this too, but a chunk at a time */
+	if (uio->uio_offset + uio->uio_resid > SFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+
+	bounce = sfs_bounce_alloc(uio, &len);
+	if (bounce == NULL) {
+		return ENOMEM;
+	}
+
+	pos = uio->uio_offset;
+	result = 0;
+	while (uio->uio_resid > 0) {
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		uio_kinit(&iov, &kuio, bounce, len, uio->uio_offset,
+			  UIO_WRITE);
+		result = uiomove(bounce, len, uio);
+		if (result) {
+			break;
+		}
+
+		rwlock_acquire_write(sv->sv_rwlock);
+		result = sfs_io(sv, &kuio);
+		rwlock_release_write(sv->sv_rwlock);
+		if (result) {
+			/*
+			 * Don't count what didn't reach the file. The
+			 * uio is finished, so its iovec can be left be.
+			 */
+			uio->uio_offset -= kuio.uio_resid;
+			uio->uio_resid += kuio.uio_resid;
+			break;
+		}
+	}
 
+	kfree(bounce);
+	if (uio->uio_offset > pos) {
+		err = vmo_filewrite(v, pos, uio->uio_offset - pos);
+		if (result == 0) {
+			result = err;
+		}
+	}
 	return result;
 }
 
@@ -1033,7 +1817,9 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 		return result;
 	}
 
+	rwlock_acquire_read(sv->sv_rwlock);
 	statbuf->st_size = sv->sv_i.sfi_size;
+	rwlock_release_read(sv->sv_rwlock);
 
 	/* We don't support these yet; you get to implement them */
 	statbuf->st_nlink = 0;
@@ -1053,16 +1839,13 @@ sfs_gettype(struct vnode *v, uint32_t *ret)
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type never changes, so there's no need to lock. */
 	switch (sv->sv_i.sfi_type) {
 	case SFS_TYPE_FILE:
 		*ret = S_IFREG;
-		vfs_biglock_release();
 		return 0;
 	case SFS_TYPE_DIR:
 		*ret = S_IFDIR;
-		vfs_biglock_release();
 		return 0;
 	}
 	panic("sfs: gettype: Invalid inode type (inode %u, type %u)\n",
@@ -1098,58 +1881,239 @@ sfs_tryseek(struct vnode *v, off_t pos)
 static
 int
 sfs_fsync(struct vnode *v)
+{
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	int result;
+
+	result = sfs_sync_vnode(v);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * The cache doesn't know which blocks are this file's, so
+	 * write back everything dirty on the device.
+	 */
+	return buf_sync(sfs->sfs_device);
+}
+
+/*
+ * Write a vnode's inode into the buffer cache. Used by close, fsync,
+ * and FS_SYNC.
+ */
+int
+sfs_sync_vnode(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_rwlock);
+	sfs_prealloc_discard(sv);
 	result = sfs_sync_inode(sv);
-	vfs_biglock_release();
+	rwlock_release_write(sv->sv_rwlock);
 
 	return result;
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Mapped pages are read and written through
+ * sfs_read and sfs_write, so any part of a regular file can be mapped.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, off_t offset, size_t len)
 {
 	(void)v;
-	return EUNIMP;
+	(void)len;
+
+	if (offset < 0) {
+		return EINVAL;
+	}
+	return 0;
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Called for ftruncate().
  */
 static
 int
 sfs_truncate(struct vnode *v, off_t len)
 {
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	/* Don't set a size the inode couldn't map */
+	if (len > SFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+
+	rwlock_acquire_write(sv->sv_rwlock);
+	result = sfs_dotruncate(sv, len);
+	rwlock_release_write(sv->sv_rwlock);
+	if (result) {
+		return result;
+	}
+
+	/* Mapped pages lose what's past the new end, as the file did */
+	return vmo_filetruncate(v, len);
+}
+
+/*
+ * Free the blocks at or past file block BLOCKLEN in the indirect
+ * block *IDBLOCKP, which is INDIRECTION levels above the data and
+ * whose first entry maps file block BASEBLOCK. Indirect blocks left
+ * with nothing in them are freed too, and *IDBLOCKP cleared if it is.
+ * Caller holds sv_rwlock for writing.
+ */
+static
+int
+sfs_truncate_indirect(struct sfs_vnode *sv, uint32_t *idblockp,
+		      int indirection, uint32_t baseblock, uint32_t blocklen)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *idbuf;
+	uint32_t *iddata;
+	uint32_t idblock, span, entry;
+	uint32_t j;
+	int result;
+	int hasnonzero, iddirty;
+
+	idblock = *idblockp;
+	if (idblock == 0) {
+		return 0;
+	}
+
+	/* Number of file blocks under each entry of this block */
+	span = 1;
+	for (j=1; j<(uint32_t)indirection; j++) {
+		span *= SFS_DBPERIDB;
+	}
+
+	/* Nothing to do if the whole block is before the new EOF */
+	if (blocklen >= baseblock + span * SFS_DBPERIDB) {
+		return 0;
+	}
+
+	/* Read the indirect block */
+	result = sfs_bread(sfs, idblock, &idbuf);
+	if (result) {
+		return result;
+	}
+	iddata = buf_data(idbuf);
+
+	result = 0;
+	hasnonzero = 0;
+	iddirty = 0;
+	for (j=0; j<SFS_DBPERIDB; j++) {
+		entry = iddata[j];
+		if (entry == 0) {
+			continue;
+		}
+
+		if (indirection > 1) {
+			/* Trim the indirect block below this entry */
+			result = sfs_truncate_indirect(sv, &iddata[j],
+						       indirection - 1,
+						       baseblock + j*span,
+						       blocklen);
+		}
+		else if (baseblock + j >= blocklen) {
+			/* Discard data blocks past the new EOF */
+			sfs_bfree(sfs, entry);
+			iddata[j] = 0;
+		}
+
+		if (iddata[j] != entry) {
+			iddirty = 1;
+		}
+		/* Remember if we see any nonzero blocks in here */
+		if (iddata[j] != 0) {
+			hasnonzero = 1;
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	if (iddirty) {
+		buf_markdirty(idbuf);
+	}
+	buf_release(idbuf);
+
+	if (result == 0 && !hasnonzero) {
+		/* The whole indirect block is empty now; free it */
+		sfs_bfree(sfs, idblock);
+		*idblockp = 0;
+		sv->sv_dirty = true;
+	}
+
+	return result;
+}
+
+/*
+ * Free the blocks at or past file block BLOCKLEN of a file with
+ * extents. Caller holds sv_rwlock for writing.
+ */
+static
+void
+sfs_truncate_extents(struct sfs_vnode *sv, uint32_t blocklen)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_extent *e;
+	uint32_t keep, j;
+	unsigned i;
+
 	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
+	 * The extents are sorted, so the ones that end up empty are
+	 * all at the end of the table, as they should be.
 	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	for (i=0; i<SFS_NEXTENTS && sv->sv_i.sfi_extents[i].sfe_nblocks > 0;
+	     i++) {
+		e = &sv->sv_i.sfi_extents[i];
+		if (e->sfe_fileblock + e->sfe_nblocks <= blocklen) {
+			continue;
+		}
+		keep = 0;
+		if (e->sfe_fileblock < blocklen) {
+			keep = blocklen - e->sfe_fileblock;
+		}
+		for (j=keep; j<e->sfe_nblocks; j++) {
+			sfs_bfree(sfs, e->sfe_diskblock + j);
+		}
+		e->sfe_nblocks = keep;
+		if (keep == 0) {
+			e->sfe_fileblock = 0;
+			e->sfe_diskblock = 0;
+		}
+		sv->sv_dirty = true;
+	}
+}
 
-	struct sfs_vnode *sv = v->vn_data;
+/*
+ * Truncate a file; the guts of sfs_truncate, also used by sfs_reclaim.
+ * Caller holds sv_rwlock for writing.
+ */
+static
+int
+sfs_dotruncate(struct sfs_vnode *sv, off_t len)
+{
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
-	uint32_t i, j, block;
-	uint32_t idblock, baseblock, highblock;
+	uint32_t i, block;
+	uint32_t baseblock;
 	int result;
-	int hasnonzero, iddirty;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	/* Blocks set aside for growing the file aren't wanted now */
+	sfs_prealloc_discard(sv);
+	sv->sv_lastdiskblock = 0;
 
-	vfs_biglock_acquire();
+	if (sv->sv_i.sfi_flags & SFS_IF_EXTENTS) {
+		sfs_truncate_extents(sv, blocklen);
+		goto done;
+	}
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -1164,63 +2128,38 @@ sfs_truncate(struct vnode *v, off_t len)
 		}
 	}
 
-	/* Indirect block number */
-	idblock = sv->sv_i.sfi_indirect;
-
-	/* The lowest block in the indirect block */
+	/*
+	 * Then the indirect trees, each starting at the file block
+	 * after the last one the previous tree covers.
+	 */
 	baseblock = SFS_NDIRECT;
+	result = sfs_truncate_indirect(sv, &sv->sv_i.sfi_indirect, 1,
+				       baseblock, blocklen);
+	if (result) {
+		return result;
+	}
 
-	/* The highest block in the indirect block */
-	highblock = baseblock + SFS_DBPERIDB - 1;
-
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
-		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
-		if (result) {
-			vfs_biglock_release();
-			return result;
-		}
-		
-		hasnonzero = 0;
-		iddirty = 0;
-		for (j=0; j<SFS_DBPERIDB; j++) {
-			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
-			}
-			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
-				hasnonzero=1;
-			}
-		}
+	baseblock += SFS_NIBLOCKS;
+	result = sfs_truncate_indirect(sv, &sv->sv_i.sfi_dindirect, 2,
+				       baseblock, blocklen);
+	if (result) {
+		return result;
+	}
 
-		if (!hasnonzero) {
-			/* The whole indirect block is empty now; free it */
-			sfs_bfree(sfs, idblock);
-			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = true;
-		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
-			if (result) {
-				vfs_biglock_release();
-				return result;
-			}
-		}
+	baseblock += SFS_NDIBLOCKS;
+	result = sfs_truncate_indirect(sv, &sv->sv_i.sfi_tindirect, 3,
+				       baseblock, blocklen);
+	if (result) {
+		return result;
 	}
 
+ done:
 	/* Set the file size */
 	sv->sv_i.sfi_size = len;
 
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1259,18 +2198,18 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	uint32_t ino;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_rwlock);
 
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return EEXIST;
 	}
 
@@ -1278,18 +2217,18 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 		/* We got a file; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
 		if (result) {
-			vfs_biglock_release();
+			rwlock_release_write(sv->sv_rwlock);
 			return result;
 		}
 		*ret = &newguy->sv_v;
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return 0;
 	}
 
 	/* Didn't exist - create it */
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return result;
 	}
 
@@ -1299,20 +2238,22 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		rwlock_release_write(sv->sv_rwlock);
 		VOP_DECREF(&newguy->sv_v);
-		vfs_biglock_release();
 		return result;
 	}
 
 	/* Update the linkcount of the new file */
+	rwlock_acquire_write(newguy->sv_rwlock);
 	newguy->sv_i.sfi_linkcount++;
 
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = true;
+	rwlock_release_write(newguy->sv_rwlock);
 
 	*ret = &newguy->sv_v;
 	
-	vfs_biglock_release();
+	rwlock_release_write(sv->sv_rwlock);
 	return 0;
 }
 
@@ -1331,20 +2272,27 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	KASSERT(file->vn_fs == dir->vn_fs);
 
-	vfs_biglock_acquire();
+	/* No hard links to directories (and we'd lock DIR twice) */
+	if (f->sv_i.sfi_type == SFS_TYPE_DIR) {
+		return EPERM;
+	}
+
+	rwlock_acquire_write(sv->sv_rwlock);
 
 	/* Just create a link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return result;
 	}
 
 	/* and update the link count, marking the inode dirty */
+	rwlock_acquire_write(f->sv_rwlock);
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
+	rwlock_release_write(f->sv_rwlock);
 
-	vfs_biglock_release();
+	rwlock_release_write(sv->sv_rwlock);
 	return 0;
 }
 
@@ -1360,28 +2308,35 @@ sfs_remove(struct vnode *dir, const char *name)
 	int slot;
 	int result;
 
-	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_rwlock);
 
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return result;
 	}
+	KASSERT(victim != sv);
 
 	/* Erase its directory entry. */
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
+		rwlock_acquire_write(victim->sv_rwlock);
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
 		victim->sv_dirty = true;
+		rwlock_release_write(victim->sv_rwlock);
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	rwlock_release_write(sv->sv_rwlock);
+
+	/*
+	 * Discard the reference that sfs_lookonce got us. This may
+	 * reclaim the file, which needn't hold up the directory.
+	 */
 	VOP_DECREF(&victim->sv_v);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1401,21 +2356,23 @@ sfs_rename(struct vnode *d1, const char *n1,
 	int slot1, slot2;
 	int result, result2;
 
-	vfs_biglock_acquire();
-
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOT_LOCATION);
 
+	rwlock_acquire_write(sv->sv_rwlock);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
-		vfs_biglock_release();
+		rwlock_release_write(sv->sv_rwlock);
 		return result;
 	}
 
 	/* We don't support subdirectories */
 	KASSERT(g1->sv_i.sfi_type == SFS_TYPE_FILE);
 
+	rwlock_acquire_write(g1->sv_rwlock);
+
 	/*
 	 * Link it under the new name.
 	 *
@@ -1447,10 +2404,12 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
 
+	rwlock_release_write(g1->sv_rwlock);
+	rwlock_release_write(sv->sv_rwlock);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 
-	vfs_biglock_release();
 	return 0;
 
  puke_harder:
@@ -1466,9 +2425,11 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 	g1->sv_i.sfi_linkcount--;
  puke:
+	rwlock_release_write(g1->sv_rwlock);
+	rwlock_release_write(sv->sv_rwlock);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1486,15 +2447,12 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type never changes, so there's no need to lock. */
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
 	if (strlen(path)+1 > buflen) {
-		vfs_biglock_release();
 		return ENAMETOOLONG;
 	}
 	strcpy(buf, path);
@@ -1502,7 +2460,6 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	VOP_INCREF(&sv->sv_v);
 	*ret = &sv->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1520,22 +2477,20 @@ sfs_lookup(struct vnode *v, char *path, struct vnode **ret)
 	struct sfs_vnode *final;
 	int result;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
-	
+
+	/* Lookups only read the directory, so they can run together */
+	rwlock_acquire_read(sv->sv_rwlock);
 	result = sfs_lookonce(sv, path, &final, NULL);
+	rwlock_release_read(sv->sv_rwlock);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	*ret = &final->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1657,6 +2612,14 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	unsigned i, num;
 	int result;
 
+	/*
+	 * Hold the table lock until the vnode is in the table (or we
+	 * have a reference to one that was), so two threads loading
+	 * the same inode get the same vnode and sfs_reclaim can't
+	 * throw it away under us.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
+
 	/* Look in the vnodes table */
 	num = vnodearray_num(sfs->sfs_vnodes);
 
@@ -1678,6 +2641,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 			KASSERT(forcetype==SFS_TYPE_INVAL);
 
 			VOP_INCREF(&sv->sv_v);
+			lock_release(sfs->sfs_vnlock);
 			*ret = sv;
 			return 0;
 		}
@@ -1687,6 +2651,14 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+
+	sv->sv_rwlock = rwlock_create("sfs_vnode");
+	if (sv->sv_rwlock == NULL) {
+		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return ENOMEM;
 	}
 
@@ -1699,13 +2671,21 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_rblock(sfs, &sv->sv_i, ino);
 	if (result) {
+		rwlock_destroy(sv->sv_rwlock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* Nothing allocated or set aside for it yet */
+	sv->sv_lastfileblock = 0;
+	sv->sv_lastdiskblock = 0;
+	sv->sv_prealloc = 0;
+	sv->sv_npreallocated = 0;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out and thus the type
@@ -1736,7 +2716,9 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		rwlock_destroy(sv->sv_rwlock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -1747,10 +2729,14 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, NULL);
 	if (result) {
 		VOP_CLEANUP(&sv->sv_v);
+		rwlock_destroy(sv->sv_rwlock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
+	lock_release(sfs->sfs_vnlock);
+
 	/* Hand it back */
 	*ret = sv;
 	return 0;
@@ -1767,14 +2753,10 @@ sfs_getroot(struct fs *fs)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOT_LOCATION, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		panic("sfs: getroot: Cannot load root vnode\n");
 	}
 
-	vfs_biglock_release();
-
 	return &sv->sv_v;
 }
@@ -58,7 +58,15 @@ struct addrspace {
         size_t as_npages2;
         paddr_t as_stackpbase;
 #else
-        struct array *as_objects;
+        struct array *as_objects;	/* sorted by base */
+        struct vm_object *as_lastvmo;	/* last region faulted on */
+        struct vm_object *as_heap;	/* also in as_objects */
+        vaddr_t as_heapbreak;		/* current sbrk break */
+        unsigned as_asid;		/* hardware address space ID */
+        unsigned as_asidgen;		/* generation as_asid belongs to */
+        uint32_t as_cpus;		/* cpus whose TLB may hold it */
+        int as_tlbbatch;		/* mmu_batchbegin depth */
+        uint32_t as_tlbwait;		/* cpus shot down in this batch */
 #endif
 };
 
@@ -94,6 +102,21 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_sbrk   - move the heap break by AMOUNT bytes (which may be
+ *                negative) and hand back the old break.
+ *
+ *    as_mmap   - map LEN bytes of a file starting at OFFSET somewhere
+ *                free, and hand back the address chosen.
+ *
+ *    as_munmap - remove a whole mapping made by as_mmap.
+ *
+ *    as_msync  - write back MAP_SHARED pages in a range to their files.
+ *
+ *    as_setfaultaround - set how many pages around a fault are mapped
+ *                along with it (0 or 1 for none).
+ *
+ *    as_printfaultstats - print what fault-around has done.
  */
 
 struct addrspace *as_create(void);
@@ -111,6 +134,18 @@ int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
 int 		  as_fault (struct addrspace *as, int faulttype, vaddr_t va);
+int 		  as_define_file (struct addrspace *as, vaddr_t vaddr,
+				  size_t filesize, struct vnode *vn,
+				  off_t offset, int shared);
+int 		  as_sbrk (struct addrspace *as, intptr_t amount,
+			   vaddr_t *oldbreak);
+int 		  as_mmap (struct addrspace *as, size_t len, int perms,
+			   struct vnode *vn, off_t offset, off_t filesize,
+			   int shared, vaddr_t *ret);
+int 		  as_munmap (struct addrspace *as, vaddr_t vaddr, size_t len);
+int 		  as_msync (struct addrspace *as, vaddr_t vaddr, size_t len);
+int 		  as_setfaultaround (unsigned npages);
+void 		  as_printfaultstats (void);
 
 /*
  * Functions in loadelf.c
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Block buffer cache.
+ */
+
+#ifndef _BUF_H_
+#define _BUF_H_
+
+struct device;
+
+/*
+ * A buffer holds one block of one device. Buffers handed out by
+ * buf_read and buf_get are busy: they belong to the caller, and
+ * anyone else who asks for the same block waits, until buf_release.
+ *
+ *    buf_read     - get the buffer for a block, reading it from the
+ *                   device if it isn't cached.
+ *    buf_get      - get the buffer for a block without reading it,
+ *                   for callers about to overwrite the whole block.
+ *                   The contents are garbage unless buf_isvalid.
+ *    buf_data     - the block's bytes.
+ *    buf_isvalid  - true if the buffer holds the block's contents.
+ *    buf_markdirty - note that the caller has changed (or, after
+ *                   buf_get, filled in) the buffer. It is written
+ *                   back later.
+ *    buf_release  - give the buffer back.
+ *
+ *    buf_readrun  - read NBLOCKS consecutive blocks (at most
+ *                   BUF_MAXRUN) into a uio in one device transfer,
+ *                   bypassing the cache but seeing any dirty buffers.
+ *    buf_writerun - write NBLOCKS consecutive blocks from a uio in one
+ *                   device transfer; cached copies are discarded.
+ *
+ *    buf_sync     - write back every dirty buffer of a device.
+ *    buf_forget   - discard a block's buffer without writing it back,
+ *                   e.g. because the block was freed.
+ *    buf_dropdev  - discard every buffer of a device, e.g. on
+ *                   unmount (after buf_sync).
+ *    buf_reclaim  - free up to NPAGES pages of clean buffers for the
+ *                   VM system; returns the number of buffers freed.
+ */
+
+struct buf;
+struct uio;
+
+/* Most blocks buf_readrun and buf_writerun move at once. */
+#define BUF_MAXRUN  32
+
+void buf_bootstrap(void);
+
+int buf_read(struct device *dev, uint32_t block, struct buf **ret);
+int buf_get(struct device *dev, uint32_t block, struct buf **ret);
+void *buf_data(struct buf *b);
+bool buf_isvalid(struct buf *b);
+void buf_markdirty(struct buf *b);
+void buf_release(struct buf *b);
+
+int buf_readrun(struct device *dev, uint32_t block, uint32_t nblocks,
+		struct uio *uio);
+int buf_writerun(struct device *dev, uint32_t block, uint32_t nblocks,
+		 struct uio *uio);
+
+int buf_sync(struct device *dev);
+void buf_forget(struct device *dev, uint32_t block);
+void buf_dropdev(struct device *dev);
+unsigned buf_reclaim(unsigned npages);
+
+void buf_printstats(void);
+
+#endif /* _BUF_H_ */
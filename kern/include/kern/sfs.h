@@ -41,6 +41,9 @@
 #define SFS_VOLNAME_SIZE  32            /* max length of volume name */
 #define SFS_NDIRECT       15            /* # of direct blocks in inode */
 #define SFS_DBPERIDB      128           /* # direct blks per indirect blk */
+#define HAS_DIDIRECT                    /* inode has a double indirect blk */
+#define HAS_TIDIRECT                    /* inode has a triple indirect blk */
+#define SFS_NEXTENTS      35            /* # of extents in inode */
 #define SFS_NAMELEN       60            /* max length of filename */
 #define SFS_SB_LOCATION    0            /* block the superblock lives in */
 #define SFS_ROOT_LOCATION  1            /* loc'n of the root dir inode */
@@ -59,6 +62,13 @@
 /* Size of bitmap (in blocks) */
 #define SFS_BITBLOCKS(nblocks)  (SFS_BITMAPSIZE(nblocks)/SFS_BLOCKBITS)
 
+/* Flags for sp_flags */
+#define SFS_SPF_EXTENTS   0x1     /* New files are mapped by extents */
+#define SFS_SPF_ALL       0x1     /* All the flags we know about */
+
+/* Flags for sfi_flags */
+#define SFS_IF_EXTENTS    0x1     /* Mapped by sfi_extents, not blocks */
+
 /* File types for sfi_type */
 #define SFS_TYPE_INVAL    0       /* Should not appear on disk */
 #define SFS_TYPE_FILE     1
@@ -71,7 +81,25 @@ struct sfs_super {
 	uint32_t sp_magic;		/* Magic number, should be SFS_MAGIC */
 	uint32_t sp_nblocks;			/* Number of blocks in fs */
 	char sp_volname[SFS_VOLNAME_SIZE];	/* Name of this volume */
-	uint32_t reserved[118];
+	uint32_t sp_flags;			/* SFS_SPF_* above */
+	uint32_t reserved[117];
+};
+
+/*
+ * On-disk extent: a run of NBLOCKS consecutive disk blocks starting
+ * at DISKBLOCK, holding the file's blocks from FILEBLOCK on.
+ *
+ * An inode with SFS_IF_EXTENTS set maps its blocks with sfi_extents
+ * alone; its direct and indirect blocks are unused and 0. The extents
+ * in use come first, sorted by sfe_fileblock and not overlapping; the
+ * rest have sfe_nblocks 0. File blocks no extent covers are holes.
+ * A file that needs more extents than that goes over to a block map:
+ * SFS_IF_EXTENTS is cleared and the extents zeroed.
+ */
+struct sfs_extent {
+	uint32_t sfe_fileblock;			/* First file block */
+	uint32_t sfe_diskblock;			/* Where it is on disk */
+	uint32_t sfe_nblocks;			/* Length of the run */
 };
 
 /*
@@ -83,7 +111,12 @@ struct sfs_inode {
 	uint16_t sfi_linkcount;			/* # hard links to this file */
 	uint32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
 	uint32_t sfi_indirect;			/* Indirect block */
-	uint32_t sfi_waste[128-3-SFS_NDIRECT];	/* unused space, set to 0 */
+	uint32_t sfi_dindirect;			/* Double indirect block */
+	uint32_t sfi_tindirect;			/* Triple indirect block */
+	uint32_t sfi_flags;			/* SFS_IF_* above */
+	struct sfs_extent sfi_extents[SFS_NEXTENTS];	/* Extents */
+	uint32_t sfi_waste[128-6-SFS_NDIRECT-3*SFS_NEXTENTS];
+						/* unused space, set to 0 */
 };
 
 /*
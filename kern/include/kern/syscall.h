@@ -196,6 +196,10 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (virtual memory, cont.)
+#define SYS_msync        121
+//                              (statistics)
+#define SYS___vmstat     122
 
 /*CALLEND*/
 
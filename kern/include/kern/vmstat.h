@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * VM statistics, as returned by the __vmstat() system call.
+ */
+
+#ifndef _KERN_VMSTAT_H_
+#define _KERN_VMSTAT_H_
+
+/*
+ * Event counts run from boot and only go up, so a benchmark takes a
+ * snapshot before and after and subtracts. Frame counts are as of the
+ * snapshot and are the same whichever cpu is asked for.
+ *
+ * Pass VMSTAT_ALLCPUS as the cpu to get events summed over all cpus.
+ */
+#define VMSTAT_ALLCPUS  (-1)
+
+struct vmstat {
+	/* Events */
+	__u32 vs_faults;        /* page faults handled */
+	__u32 vs_tlbmisses;     /* TLB entries loaded */
+	__u32 vs_tlbevictions;  /* valid TLB entries replaced */
+	__u32 vs_zerofills;     /* new zero-filled pages */
+	__u32 vs_cowcopies;     /* pages copied on write */
+	__u32 vs_pageins;       /* pages read from swap */
+	__u32 vs_pageouts;      /* pages written to swap */
+	__u32 vs_pinwaits;      /* waits for a busy frame */
+
+	/* Frames */
+	__u32 vs_framesfree;    /* free */
+	__u32 vs_frameskernel;  /* holding kernel memory */
+	__u32 vs_framesuser;    /* holding user pages */
+};
+
+#endif /* _KERN_VMSTAT_H_ */
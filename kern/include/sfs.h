@@ -48,11 +48,28 @@
  */
 #include <kern/sfs.h>
 
+struct buf;
+
+/*
+ * Locking: sv_rwlock covers an object's inode and contents; it is held
+ * for reading to read them and for writing to change them. A directory
+ * is locked before the files in it. sfs_vnlock covers sfs_vnodes and
+ * comes after any vnode's lock; sfs_freemaplock covers the freemap,
+ * superblock, and sfs_allochint and comes last. The allocation fields
+ * of a vnode go with sv_rwlock. Blocks themselves are kept consistent by
+ * the buffer cache.
+ */
+
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct rwlock *sv_rwlock;       /* lock for sv_i and the data */
+	uint32_t sv_lastfileblock;      /* last block allocated, in file */
+	uint32_t sv_lastdiskblock;      /* ...and on disk, or 0 if none */
+	uint32_t sv_prealloc;           /* first block set aside for file */
+	uint32_t sv_npreallocated;      /* number of blocks set aside */
 };
 
 struct sfs_fs {
@@ -61,8 +78,11 @@ struct sfs_fs {
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct lock *sfs_vnlock;        /* lock for sfs_vnodes */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	struct lock *sfs_freemaplock;   /* lock for freemap and super */
+	uint32_t sfs_allochint;         /* where to look for new inodes */
 };
 
 /*
@@ -75,15 +95,15 @@ int sfs_mount(const char *device);
  * Internal functions
  */
 
-/* Initialize uio structure */
-#define SFSUIO(iov, uio, ptr, block, rw) \
-    uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
-
-/* Convenience functions for block I/O */
-int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
+/* Block I/O, through the buffer cache (see buf.h) */
+int sfs_bread(struct sfs_fs *sfs, uint32_t block, struct buf **ret);
+int sfs_bget(struct sfs_fs *sfs, uint32_t block, struct buf **ret);
 int sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
 
+/* Write a vnode's inode to the buffer cache, if it has changed */
+int sfs_sync_vnode(struct vnode *v);
+
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
@@ -145,10 +145,22 @@ void cv_broadcast(struct cv *cv, struct lock *lock);
 
 /*
  * 13 Feb 2012 : GWA : Reader-writer locks.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Waiting writers go first: a reader that arrives while a writer is
+ * waiting waits behind it. So a thread holding the lock for reading
+ * must not acquire it for reading again.
  */
 
 struct rwlock {
         char *rwlock_name;
+
+        struct spinlock rw_lock;
+        struct wchan *rw_rwchan;        /* readers waiting */
+        struct wchan *rw_wwchan;        /* writers waiting */
+        unsigned rw_readers;            /* readers holding it */
+        unsigned rw_wwaiting;           /* writers waiting */
+        volatile struct thread *rw_writer; /* writer holding it */
 };
 
 struct rwlock * rwlock_create(const char *);
@@ -158,5 +170,6 @@ void rwlock_acquire_read(struct rwlock *);
 void rwlock_release_read(struct rwlock *);
 void rwlock_acquire_write(struct rwlock *);
 void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
 
 #endif /* _SYNCH_H_ */
@@ -74,6 +74,11 @@ int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
 void execv_bootstrap(void);
 void execv_shutdown(void);
-void *sys_sbrk(intptr_t amount);
+int sys_sbrk(intptr_t amount, int *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	     off_t offset, int *retval);
+int sys_munmap(userptr_t addr, size_t len);
+int sys_msync(userptr_t addr, size_t len, int flags);
+int sys___vmstat(userptr_t buf, int cpu);
  
 #endif /* _SYSCALL_H_ */
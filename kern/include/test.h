@@ -102,6 +102,7 @@ int printfile(int, char **);
 /* other tests */
 int malloctest(int, char **);
 int mallocstress(int, char **);
+int cmbench(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
@@ -122,6 +122,9 @@ void thread_bootstrap(void);
 /* Call late in system startup to get secondary CPUs running. */
 void thread_start_cpus(void);
 
+/* Number of CPUs in the system (software numbers run 0 to this - 1). */
+unsigned thread_numcpus(void);
+
 /* Call during panic to stop other threads in their tracks */
 void thread_panic(void);
 
@@ -38,10 +38,15 @@
 
 extern struct lock *paging_lock;
 
+struct vnode;
+struct addrspace;
+
 struct lpage {
 	paddr_t paddr;
 	off_t swapaddr;
 	struct lock *lock;
+	unsigned refcount;	// vm_objects sharing this page copy-on-write
+	int mapdirty;		// written through MAP_SHARED since last synced
 };
 
 #define LPF_DIRTY		0x1
@@ -54,31 +59,97 @@ struct lpage {
 
 struct lpage *lp_create (void);
 int lp_copy (struct lpage *fromlp, struct lpage **tolp);
-int lp_fault (struct lpage *lp, struct addrspace *as, int faulttype, vaddr_t va);
-void lp_evict (struct lpage *lp);
+void lp_share (struct lpage *lp);
+int lp_isshared (struct lpage *lp);
+int lp_isresident (struct lpage *lp);
+int lp_fault (struct lpage *lp, struct addrspace *as, int faulttype, vaddr_t va,
+	      int writable, int mapshared);
+unsigned lp_prefetch (struct lpage **lps, unsigned n);
+int lp_prefault (struct lpage *lp, struct addrspace *as, vaddr_t va,
+		 int writable, int mapshared);
+int lp_evict (struct lpage *lp);
+int lp_clean (struct lpage *lp);
+void lp_move (struct lpage *lp, paddr_t newpa);
 int lp_zero (struct lpage **lpret);
+int lp_fill (struct lpage **lpret, struct vnode *vn, off_t offset,
+	     size_t pgoff, size_t len);
+int lp_writeback (struct lpage *lp, struct vnode *vn, off_t offset,
+		  size_t len);
+int lp_update (struct lpage *lp, size_t pgoff, size_t len, struct vnode *vn,
+	       off_t offset);
 void lp_destroy (struct lpage *lp);
 
+struct vmo_text;
+struct vmo_file;
+
 struct vm_object {
 	struct array *lpages;
 	vaddr_t base;
 	size_t redzone; // disallow other vm_objects
+	int perms;	// VMO_R | VMO_W | VMO_X
+
+	// pages not yet touched are read from here instead of zero-filled
+	struct vnode *vn;	// backing executable, or NULL
+	off_t vnoffset;		// file offset of vnvaddr
+	vaddr_t vnvaddr;	// first byte backed by the file
+	size_t vnsize;		// bytes backed by the file
+	struct vmo_text *text;	// clean pages shared by all runs of vn
+	struct vmo_file *file;	// pages of vn shared by all its mappings
+	int shared;		// MAP_SHARED: writes go to the file
+	int zeromapped;		// some untouched page maps the zero frame
 };
 
+// vm_object permissions
+// - MIPS can only refuse writes; read and execute are recorded only
+#define VMO_R		0x4
+#define VMO_W		0x2
+#define VMO_X		0x1
+
 struct vm_object *vmo_create (size_t npages);
-int vmo_copy (struct vm_object *vmo, struct addrspace *newas, struct vm_object **ret);
+int vmo_copy (struct vm_object *vmo, struct addrspace *oldas,
+	      struct addrspace *newas, struct vm_object **ret);
 int vmo_resize (struct addrspace *as, struct vm_object *vmo, int npages);
 void vmo_destroy (struct addrspace *as, struct vm_object *vmo);
+int vmo_setfile (struct vm_object *vmo, struct vnode *vn, off_t offset,
+		 vaddr_t vaddr, size_t filesize, int share);
+int vmo_setmap (struct vm_object *vmo, struct vnode *vn, off_t offset,
+		off_t filesize, int shared);
+int vmo_fill (struct vm_object *vmo, unsigned index, struct lpage **ret);
+int vmo_mapzero (struct addrspace *as, struct vm_object *vmo, unsigned index);
+void vmo_printzerostats (void);
+int vmo_sync (struct vm_object *vmo, unsigned first, unsigned npages);
+int vmo_filewrite (struct vnode *vn, off_t offset, size_t len);
+int vmo_filetruncate (struct vnode *vn, off_t len);
+void vmo_bootstrap (void);
 
 #define INVALID_SWAPADDR (0)
 
+// most pages swap_pageinv reads in one request
+#define SWAP_MAXRUN 16
+
 void swap_bootstrap (size_t pmemsize);
 void swap_shutdown (void);
+int swap_reserve (void);
+void swap_unreserve (void);
+void swap_setovercommit (int on);
+void swap_printstats (void);
 off_t swap_allocate (void);
 void swap_deallocate (off_t diskpage);
 void swap_pagein (paddr_t paddr, off_t swapaddr);
+void swap_pageinv (const paddr_t *pas, off_t swapaddr, unsigned npages);
 void swap_pageout (paddr_t paddr, off_t swapaddr);
 
+void pageout_bootstrap (void);
+
+void vm_printtlbstats (void);
+void vm_printfaultstats (void);
+void vm_printvmstat (void);
+int vm_setfaultaround (unsigned npages);
+int vm_setovercommit (int on);
+int vm_idle (void);
+unsigned vm_freepages (void);
+int vm_settlbpolicy (const char *name);
+
 // DEFAULT //
 
 /* Fault-type arguments to vm_fault() */
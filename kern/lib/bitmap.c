@@ -95,29 +95,79 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
+/*
+ * Find the first clear bit at or after FROM and before TO. Full words
+ * are skipped four at a time where they're aligned for it (being all
+ * ones, they read the same in any byte order), and the clear bit in a
+ * word is found with a count-trailing-zeros instead of a loop.
+ */
+static
+int
+bitmap_search(struct bitmap *b, unsigned from, unsigned to, unsigned *index)
+{
+        unsigned ix, maxix, bit;
+        WORD_TYPE w;
+
+        if (from >= to) {
+                return ENOSPC;
+        }
+
+        ix = from / BITS_PER_WORD;
+        maxix = DIVROUNDUP(to, BITS_PER_WORD);
+
+        /* Ignore the bits before FROM in its word */
+        w = b->v[ix] | (WORD_TYPE)((1U << (from % BITS_PER_WORD)) - 1);
+
+        while (w == WORD_ALLBITS) {
+                ix++;
+                while (ix % sizeof(uint32_t) == 0 &&
+                       ix + sizeof(uint32_t) <= maxix &&
+                       *(uint32_t *)&b->v[ix] == 0xffffffff) {
+                        ix += sizeof(uint32_t);
+                }
+                if (ix >= maxix) {
+                        return ENOSPC;
+                }
+                w = b->v[ix];
+        }
+
+        bit = ix*BITS_PER_WORD + __builtin_ctz(~(unsigned)w);
+        if (bit >= to) {
+                return ENOSPC;
+        }
+        *index = bit;
+        return 0;
+}
+
 int
 bitmap_alloc(struct bitmap *b, unsigned *index)
 {
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        return bitmap_alloc_near(b, 0, index);
+}
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
-
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
-                                        return 0;
-                                }
-                        }
-                        KASSERT(0);
+int
+bitmap_alloc_near(struct bitmap *b, unsigned goal, unsigned *index)
+{
+        unsigned bit;
+        int result;
+
+        if (goal >= b->nbits) {
+                goal = 0;
+        }
+
+        /* Look from GOAL to the end, then wrap around */
+        result = bitmap_search(b, goal, b->nbits, &bit);
+        if (result) {
+                result = bitmap_search(b, 0, goal, &bit);
+                if (result) {
+                        return result;
                 }
         }
-        return ENOSPC;
+
+        KASSERT(bit < b->nbits);
+        b->v[bit / BITS_PER_WORD] |= ((WORD_TYPE)1) << (bit % BITS_PER_WORD);
+        *index = bit;
+        return 0;
 }
 
 static
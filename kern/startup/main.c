@@ -44,6 +44,7 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
+#include <buf.h>
 #include <device.h>
 #include <syscall.h>
 #include <test.h>
@@ -113,6 +114,7 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	buf_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
@@ -120,6 +122,7 @@ boot(void)
 	mainbus_bootstrap();
 	KASSERT(curthread->t_curspl == 0);
 	swap_bootstrap(memsize);
+	pageout_bootstrap();
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
@@ -154,6 +157,7 @@ shutdown(void)
 	vfs_clearbootfs();
 	vfs_clearcurdir();
 	vfs_unmountall();
+	swap_shutdown();
 
 	thread_shutdown();
 
@@ -36,7 +36,9 @@
 #include <uio.h>
 #include <clock.h>
 #include <thread.h>
+#include <vm.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
@@ -44,6 +46,7 @@
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-dumbvm.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -387,6 +390,97 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_bufstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	buf_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_vmstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_printvmstat();
+
+	return 0;
+}
+
+static
+int
+cmd_tlbstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_printtlbstats();
+
+	return 0;
+}
+
+static
+int
+cmd_faultstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_printfaultstats();
+
+	return 0;
+}
+
+static
+int
+cmd_tlbpolicy(int nargs, char **args)
+{
+	if (nargs != 2) {
+		kprintf("Usage: tlbp rr|random|lru\n");
+		return EINVAL;
+	}
+
+	return vm_settlbpolicy(args[1]);
+}
+
+static
+int
+cmd_faultaround(int nargs, char **args)
+{
+	if (nargs != 2) {
+		kprintf("Usage: far <pages>\n");
+		return EINVAL;
+	}
+
+	return vm_setfaultaround(atoi(args[1]));
+}
+
+static
+int
+cmd_overcommit(int nargs, char **args)
+{
+	if (nargs != 2) {
+		kprintf("Usage: ovc on|off\n");
+		return EINVAL;
+	}
+
+	if (!strcmp(args[1], "on")) {
+		return vm_setovercommit(1);
+	}
+	if (!strcmp(args[1], "off")) {
+		return vm_setovercommit(0);
+	}
+	kprintf("Usage: ovc on|off\n");
+	return EINVAL;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -447,6 +541,9 @@ static const char *testmenu[] = {
 	"[bt]  Bitmap test                   ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
+#if !OPT_DUMBVM
+	"[cmb] Frame allocator benchmark     ",
+#endif
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -488,6 +585,13 @@ static const char *mainmenu[] = {
 	"[?o] Operations menu                ",
 	"[?t] Tests menu                     ",
 	"[kh] Kernel heap stats              ",
+	"[vs] VM stats                       ",
+	"[bc] Buffer cache stats             ",
+	"[tlb] TLB stats                     ",
+	"[tlbp] Set TLB policy               ",
+	"[flt] Fault latency histogram       ",
+	"[far] Set fault-around window       ",
+	"[ovc] Swap overcommit on/off        ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -536,12 +640,22 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "vs",         cmd_vmstats },
+	{ "bc",         cmd_bufstats },
+	{ "tlb",        cmd_tlbstats },
+	{ "tlbp",       cmd_tlbpolicy },
+	{ "flt",        cmd_faultstats },
+	{ "far",        cmd_faultaround },
+	{ "ovc",        cmd_overcommit },
 
 	/* base system tests */
 	{ "at",		arraytest },
 	{ "bt",		bitmaptest },
 	{ "km1",	malloctest },
 	{ "km2",	mallocstress },
+#if !OPT_DUMBVM
+	{ "cmb",	cmbench },
+#endif
 #if OPT_NET
 	{ "net",	nettest },
 #endif
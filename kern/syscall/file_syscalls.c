@@ -268,14 +268,3 @@ sys___getcwd(userptr_t buf, size_t buflen, int *retval)
 
 	return 0;
 }
-
-void*
-sys_sbrk(intptr_t amount) 
-{
-	vaddr_t bot, top;
-	struct vm_object *vmo = NULL;
-
-	vmo = array_get(curthread->t_addrspace->as_objects);
-
-
-}
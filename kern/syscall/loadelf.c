@@ -59,6 +59,7 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include "opt-dumbvm.h"
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -73,19 +74,23 @@
  * executable whose load address is in kernel space. If you should
  * change this code to not use uiomove, be sure to check for this case
  * explicitly.
+ *
+ * Without dumbvm nothing is read here: the region is backed by the
+ * executable and each page is read when it is first touched. Segments
+ * that are not writeable are shared by every process running the same
+ * executable.
  */
 static
 int
 load_segment(struct vnode *v, off_t offset, vaddr_t vaddr, 
 	     size_t memsize, size_t filesize,
-	     int is_executable)
+	     int is_executable, int is_writeable)
 {
+#if OPT_DUMBVM
 	struct iovec iov;
 	struct uio u;
+	size_t fillamt;
 	int result;
-
-#if !OPT_DUMBVM
-	vaddr_t fillbase, pageboundary;
 #endif
 
 	if (filesize > memsize) {
@@ -93,6 +98,25 @@ load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 		filesize = memsize;
 	}
 
+#if !OPT_DUMBVM
+	(void)is_executable;
+
+	if (vaddr >= USERSPACETOP || memsize > USERSPACETOP - vaddr) {
+		return EFAULT;
+	}
+
+	DEBUG(DB_EXEC, "ELF: Mapping %lu bytes at 0x%lx\n",
+	      (unsigned long) filesize, (unsigned long) vaddr);
+
+	if (filesize == 0) {
+		/* all bss; the VM system zero-fills it on demand */
+		return 0;
+	}
+	return as_define_file(curthread->t_addrspace, vaddr, filesize,
+			      v, offset, !is_writeable);
+#else
+	(void)is_writeable;
+
 	DEBUG(DB_EXEC, "ELF: Loading %lu bytes to 0x%lx\n", 
 	      (unsigned long) filesize, (unsigned long) vaddr);
 
@@ -132,21 +156,8 @@ load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 	 * you submit your code for grading.
 	 */
 
-		size_t fillamt;
-
 		fillamt = memsize - filesize;
 
-#if !OPT_DUMBVM
-	/*
-	 * optimization: skip pages we haven't already touched;
-	 * let the VM system zerofill them for us on demand.
-	 */
-	fillbase = vaddr + filesize;
-	pageboundary = (fillbase + PAGE_SIZE - 1) & PAGE_FRAME;
-	if (fillbase + fillamt > pageboundary) {
-		fillamt = pageboundary - fillbase;
-	}
-#endif
 		if (fillamt > 0) {
 			DEBUG(DB_EXEC, "ELF: Zero-filling %lu more bytes\n", 
 			      (unsigned long) fillamt);
@@ -156,6 +167,7 @@ load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 
 	
 	return result;
+#endif
 }
 
 /*
@@ -300,7 +312,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 		result = load_segment(v, ph.p_offset, ph.p_vaddr, 
 				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+				      ph.p_flags & PF_X,
+				      ph.p_flags & PF_W);
 		if (result) {
 			return result;
 		}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Memory-related system call implementations.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
+#include <kern/vmstat.h>
+#include <lib.h>
+#include <thread.h>
+#include <current.h>
+#include <vnode.h>
+#include <file.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <syscall.h>
+#include <copyinout.h>
+#include <vmstat.h>
+
+/*
+ * sys_sbrk
+ * moves the heap break and returns the old one. The new pages are
+ * not touched here; they are zero-filled when first faulted on.
+ */
+int
+sys_sbrk(intptr_t amount, int *retval)
+{
+	vaddr_t oldbreak;
+	int result;
+
+	result = as_sbrk(curthread->t_addrspace, amount, &oldbreak);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int)oldbreak;
+	return 0;
+}
+
+/*
+ * sys_mmap
+ * maps part of an open file. The address is only a hint and is
+ * ignored; the kernel picks where the mapping goes. Nothing is read
+ * here: pages come in from the file when first touched.
+ */
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int *retval)
+{
+	struct openfile *file;
+	struct stat st;
+	vaddr_t va;
+	int perms, shared;
+	int result;
+
+	(void)addr;
+
+	if (len == 0 || offset < 0 || offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	if ((prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC)) != 0) {
+		return EINVAL;
+	}
+	switch (flags & MAP_TYPE) {
+	    case MAP_SHARED: shared = 1; break;
+	    case MAP_PRIVATE: shared = 0; break;
+	    default: return EINVAL;
+	}
+	if ((flags & ~MAP_TYPE) != 0) {
+		return EINVAL;
+	}
+
+	result = filetable_findfile(fd, &file);
+	if (result) {
+		return result;
+	}
+
+	/* the pages are read from the file, and maybe written back */
+	if (file->of_accmode == O_WRONLY) {
+		return EACCES;
+	}
+	if (shared && (prot & PROT_WRITE) && file->of_accmode != O_RDWR) {
+		return EACCES;
+	}
+
+	result = VOP_MMAP(file->of_vnode, offset, len);
+	if (result) {
+		return result;
+	}
+
+	result = VOP_STAT(file->of_vnode, &st);
+	if (result) {
+		return result;
+	}
+
+	perms = ((prot & PROT_READ) ? VMO_R : 0) |
+		((prot & PROT_WRITE) ? VMO_W : 0) |
+		((prot & PROT_EXEC) ? VMO_X : 0);
+
+	result = as_mmap(curthread->t_addrspace, len, perms, file->of_vnode,
+			 offset, st.st_size, shared, &va);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int)va;
+	return 0;
+}
+
+/*
+ * sys_munmap
+ * removes a mapping made by mmap; it has to be the whole mapping.
+ */
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	return as_munmap(curthread->t_addrspace, (vaddr_t)addr, len);
+}
+
+/*
+ * sys_msync
+ * writes modified MAP_SHARED pages in a range back to their files.
+ * The write-back always happens before returning, so MS_ASYNC is
+ * treated like MS_SYNC.
+ */
+int
+sys_msync(userptr_t addr, size_t len, int flags)
+{
+	if ((flags & ~(MS_ASYNC|MS_SYNC|MS_INVALIDATE)) != 0 ||
+	    (flags & (MS_ASYNC|MS_SYNC)) == (MS_ASYNC|MS_SYNC)) {
+		return EINVAL;
+	}
+
+	return as_msync(curthread->t_addrspace, (vaddr_t)addr, len);
+}
+
+/*
+ * sys___vmstat
+ * copies out a snapshot of the VM statistics, for one cpu or summed
+ * over all of them (VMSTAT_ALLCPUS).
+ */
+int
+sys___vmstat(userptr_t buf, int cpu)
+{
+	struct vmstat vs;
+	int result;
+
+	result = vmstat_get(cpu, &vs);
+	if (result) {
+		return result;
+	}
+
+	return copyout(&vs, buf, sizeof(vs));
+}
@@ -101,6 +101,35 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/* Free some bits again and check that allocating near a goal
+	   gets the first free one from the goal on, wrapping around. */
+	for (i=0; i<TESTSIZE; i++) {
+		if (random()%4 == 0) {
+			bitmap_unmark(b, i);
+			data[i] = 1;
+		}
+	}
+	for (;;) {
+		uint32_t goal = random()%TESTSIZE;
+		uint32_t want;
+
+		for (want=0; want<TESTSIZE; want++) {
+			if (data[(goal+want) % TESTSIZE]) {
+				break;
+			}
+		}
+		if (want == TESTSIZE) {
+			KASSERT(bitmap_alloc_near(b, goal, &x) != 0);
+			break;
+		}
+		want = (goal+want) % TESTSIZE;
+
+		KASSERT(bitmap_alloc_near(b, goal, &x)==0);
+		KASSERT(x == want);
+		KASSERT(bitmap_isset(b, x));
+		data[x] = 0;
+	}
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
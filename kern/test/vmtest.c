@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <vm.h>
+#include <test.h>
+
+/*
+ * Frame allocator benchmark.
+ *
+ * Each worker allocates CMB_BATCH pages with alloc_kpages, frees them
+ * again, and repeats CMB_ROUNDS times. The run is repeated with 1, 2,
+ * 4, ... workers up to the requested maximum, so the allocation rate
+ * can be compared as more CPUs contend for the coremap.
+ */
+
+#define CMB_ROUNDS	500
+#define CMB_BATCH	16
+#define CMB_MAXTHREADS	8
+
+struct cmb_worker {
+	struct semaphore *done;
+	unsigned allocs;		/* pages this worker got */
+	int failed;			/* alloc_kpages returned 0 */
+};
+
+static
+void
+cmbthread(void *data, unsigned long num)
+{
+	struct cmb_worker *w = data;
+	vaddr_t pages[CMB_BATCH];
+	int i, j, n;
+
+	(void)num;
+
+	for (i=0; i<CMB_ROUNDS && !w->failed; i++) {
+		for (n=0; n<CMB_BATCH; n++) {
+			pages[n] = alloc_kpages(1);
+			if (pages[n] == 0) {
+				w->failed = 1;
+				break;
+			}
+			w->allocs++;
+		}
+		for (j=0; j<n; j++) {
+			free_kpages(pages[j]);
+		}
+	}
+
+	V(w->done);
+}
+
+static
+void
+cmbrun(struct semaphore *done, int nthreads)
+{
+	struct cmb_worker workers[CMB_MAXTHREADS];
+	time_t secs1, secs2, rsecs;
+	uint32_t nsecs1, nsecs2, rnsecs;
+	unsigned allocs, msecs;
+	int i, failed, result;
+
+	for (i=0; i<nthreads; i++) {
+		workers[i].done = done;
+		workers[i].allocs = 0;
+		workers[i].failed = 0;
+	}
+
+	gettime(&secs1, &nsecs1);
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("cmbench", cmbthread, &workers[i], i,
+				     NULL);
+		if (result) {
+			panic("cmbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(done);
+	}
+
+	gettime(&secs2, &nsecs2);
+	getinterval(secs1, nsecs1, secs2, nsecs2, &rsecs, &rnsecs);
+
+	allocs = 0;
+	failed = 0;
+	for (i=0; i<nthreads; i++) {
+		allocs += workers[i].allocs;
+		failed |= workers[i].failed;
+	}
+
+	msecs = rsecs * 1000 + rnsecs / 1000000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+
+	kprintf("%2d thread(s): %u allocations in %u.%03u s, %u/s%s\n",
+		nthreads, allocs, msecs / 1000, msecs % 1000,
+		(unsigned)((uint64_t)allocs * 1000 / msecs),
+		failed ? " (ran out of memory)" : "");
+}
+
+int
+cmbench(int nargs, char **args)
+{
+	struct semaphore *done;
+	int maxthreads, n;
+
+	maxthreads = 4;
+	if (nargs > 2) {
+		kprintf("Usage: cmb [maxthreads]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		maxthreads = atoi(args[1]);
+	}
+	if (maxthreads < 1 || maxthreads > CMB_MAXTHREADS) {
+		kprintf("cmb: maxthreads must be between 1 and %d\n",
+			CMB_MAXTHREADS);
+		return EINVAL;
+	}
+
+	done = sem_create("cmbench", 0);
+	if (done == NULL) {
+		panic("cmbench: sem_create failed\n");
+	}
+
+	kprintf("Starting frame allocator benchmark...\n");
+	for (n=1; n<=maxthreads; n*=2) {
+		cmbrun(done, n);
+	}
+	kprintf("Frame allocator benchmark done\n");
+
+	sem_destroy(done);
+
+	return 0;
+}
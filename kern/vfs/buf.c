@@ -0,0 +1,846 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Block buffer cache.
+ *
+ * Caches device blocks for file systems. Each buffer holds one block
+ * of one device and is found by hashing the device and block number.
+ * Every buffer is also on an LRU list, most recently used first; when
+ * the cache is full the least recently used idle buffer is written
+ * back if dirty and reused.
+ *
+ * Dirty buffers reach the disk when they are reused, on buf_sync, or
+ * never, if the block is freed first (buf_forget).
+ *
+ * The cache may grow to a fraction of the memory the VM system had
+ * free at boot. When memory runs short the pageout daemon calls
+ * buf_reclaim, which frees clean buffers and lowers the limit; the
+ * limit creeps back up one block per miss once memory is plentiful
+ * again.
+ *
+ * buf_lock covers the hash table, the LRU list, the counters, and
+ * the flags of every buffer. I/O is done without it, on busy buffers,
+ * which nobody else touches.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <uio.h>
+#include <vm.h>
+#include <device.h>
+#include <buf.h>
+
+/* Number of hash chains (a power of two). */
+#define BUF_HASHSIZE     256
+
+/* The cache may use 1/BUF_MEMFRACTION of the memory free at boot... */
+#define BUF_MEMFRACTION  8
+
+/* ...but never has to shrink below this. */
+#define BUF_MINBYTES     (16*1024)
+
+struct buf {
+	struct device *b_dev;		/* device, or NULL if unassigned */
+	uint32_t b_block;		/* block number on b_dev */
+	size_t b_size;			/* bytes in b_data */
+	void *b_data;			/* the block */
+	bool b_valid;			/* b_data holds the block */
+	bool b_dirty;			/* b_data is newer than the disk */
+	bool b_busy;			/* handed out and not released */
+	bool b_syncing;			/* buf_sync still has to write it */
+	struct buf *b_hashnext;		/* hash chain */
+	struct buf *b_lruprev;		/* LRU list */
+	struct buf *b_lrunext;
+};
+
+static struct spinlock buf_lock;
+static struct wchan *buf_wchan;		/* waiting for a busy buffer */
+static struct buf *buf_hash[BUF_HASHSIZE];
+static struct buf *buf_lruhead;		/* most recently used */
+static struct buf *buf_lrutail;		/* least recently used */
+
+static unsigned buf_count;		/* buffers allocated */
+static size_t buf_bytes;		/* bytes of block data allocated */
+static size_t buf_limit;		/* current cap on buf_bytes */
+static size_t buf_maxbytes;		/* cap when memory is plentiful */
+
+static uint32_t buf_stat_hits;
+static uint32_t buf_stat_misses;
+static uint32_t buf_stat_reads;		/* blocks read from devices */
+static uint32_t buf_stat_writes;	/* blocks written to devices */
+static uint32_t buf_stat_reuses;	/* buffers taken for another block */
+static uint32_t buf_stat_reclaimed;	/* buffers freed for the VM */
+static uint32_t buf_stat_runs;		/* buf_readrun/buf_writerun calls */
+static uint32_t buf_stat_runblocks;	/* blocks they moved */
+
+////////////////////////////////////////////////////////////
+//
+// Lists
+
+static
+unsigned
+buf_hashfn(struct device *dev, uint32_t block)
+{
+	return (block ^ ((uintptr_t)dev >> 4)) & (BUF_HASHSIZE - 1);
+}
+
+static
+struct buf *
+buf_find(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	for (b = buf_hash[buf_hashfn(dev, block)]; b != NULL;
+	     b = b->b_hashnext) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+buf_hashinsert(struct buf *b)
+{
+	unsigned h;
+
+	KASSERT(b->b_dev != NULL);
+	h = buf_hashfn(b->b_dev, b->b_block);
+	b->b_hashnext = buf_hash[h];
+	buf_hash[h] = b;
+}
+
+static
+void
+buf_hashremove(struct buf *b)
+{
+	struct buf **bp;
+
+	KASSERT(b->b_dev != NULL);
+	bp = &buf_hash[buf_hashfn(b->b_dev, b->b_block)];
+	while (*bp != b) {
+		KASSERT(*bp != NULL);
+		bp = &(*bp)->b_hashnext;
+	}
+	*bp = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+static
+void
+buf_lruremove(struct buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		buf_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		buf_lrutail = b->b_lruprev;
+	}
+	b->b_lruprev = b->b_lrunext = NULL;
+}
+
+/* Put B at the head of the LRU list, or at the tail if it's unwanted. */
+static
+void
+buf_lruinsert(struct buf *b, bool athead)
+{
+	if (athead) {
+		b->b_lruprev = NULL;
+		b->b_lrunext = buf_lruhead;
+		if (buf_lruhead != NULL) {
+			buf_lruhead->b_lruprev = b;
+		}
+		else {
+			buf_lrutail = b;
+		}
+		buf_lruhead = b;
+	}
+	else {
+		b->b_lrunext = NULL;
+		b->b_lruprev = buf_lrutail;
+		if (buf_lrutail != NULL) {
+			buf_lrutail->b_lrunext = b;
+		}
+		else {
+			buf_lruhead = b;
+		}
+		buf_lrutail = b;
+	}
+}
+
+/* Take B out of the hash table so it can be reused. */
+static
+void
+buf_unassign(struct buf *b)
+{
+	KASSERT(!b->b_busy);
+	if (b->b_dev != NULL) {
+		buf_hashremove(b);
+		b->b_dev = NULL;
+	}
+	b->b_valid = false;
+	b->b_dirty = false;
+	b->b_syncing = false;
+	buf_lruremove(b);
+	buf_lruinsert(b, false);
+}
+
+/*
+ * Wait for some busy buffer to be released. Called and returns with
+ * buf_lock held; the caller must look again at whatever it wanted.
+ */
+static
+void
+buf_wait(void)
+{
+	wchan_lock(buf_wchan);
+	spinlock_release(&buf_lock);
+	wchan_sleep(buf_wchan);
+	spinlock_acquire(&buf_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Buffers
+
+static
+struct buf *
+buf_create(size_t size)
+{
+	struct buf *b;
+
+	b = kmalloc(sizeof(struct buf));
+	if (b == NULL) {
+		return NULL;
+	}
+	b->b_data = kmalloc(size);
+	if (b->b_data == NULL) {
+		kfree(b);
+		return NULL;
+	}
+	b->b_dev = NULL;
+	b->b_block = 0;
+	b->b_size = size;
+	b->b_valid = false;
+	b->b_dirty = false;
+	b->b_busy = false;
+	b->b_syncing = false;
+	b->b_hashnext = NULL;
+	b->b_lruprev = b->b_lrunext = NULL;
+	return b;
+}
+
+static
+void
+buf_destroy(struct buf *b)
+{
+	kfree(b->b_data);
+	kfree(b);
+}
+
+/*
+ * Read or write LEN bytes at DATA from or to the device, starting at
+ * BLOCK. Out-of-range requests are our own bug; I/O errors are retried
+ * a few times before giving up.
+ */
+static
+int
+buf_devio(struct device *dev, uint32_t block, void *data, size_t len,
+	  enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+	int tries = 0;
+
+	DEBUG(DB_VFS, "buf: %s %u (%u bytes)\n",
+	      rw == UIO_READ ? "read" : "write", block, len);
+
+ retry:
+	uio_kinit(&iov, &ku, data, len, ((off_t)block) * dev->d_blocksize, rw);
+	result = dev->d_io(dev, &ku);
+	if (result == EINVAL) {
+		/*
+		 * The block was out of range, or something else that's
+		 * the file system's fault.
+		 */
+		panic("buf: d_io returned EINVAL\n");
+	}
+	if (result == EIO) {
+		if (tries == 0) {
+			tries++;
+			kprintf("buf: block %u I/O error, retrying\n", block);
+			goto retry;
+		}
+		else if (tries < 10) {
+			tries++;
+			goto retry;
+		}
+		else {
+			kprintf("buf: block %u I/O error, giving up after "
+				"%d retries\n", block, tries);
+		}
+	}
+	return result;
+}
+
+/*
+ * Read or write a busy buffer.
+ */
+static
+int
+buf_io(struct buf *b, enum uio_rw rw)
+{
+	KASSERT(b->b_busy);
+
+	spinlock_acquire(&buf_lock);
+	if (rw == UIO_READ) {
+		buf_stat_reads++;
+	}
+	else {
+		buf_stat_writes++;
+	}
+	spinlock_release(&buf_lock);
+
+	return buf_devio(b->b_dev, b->b_block, b->b_data, b->b_size, rw);
+}
+
+/*
+ * Write back a dirty buffer that isn't busy. Called and returns with
+ * buf_lock held, but drops it during the write.
+ */
+static
+int
+buf_writeback(struct buf *b)
+{
+	int result;
+
+	KASSERT(!b->b_busy);
+	KASSERT(b->b_dirty);
+
+	b->b_busy = true;
+	spinlock_release(&buf_lock);
+
+	result = buf_io(b, UIO_WRITE);
+
+	spinlock_acquire(&buf_lock);
+	b->b_busy = false;
+	if (result == 0) {
+		b->b_dirty = false;
+	}
+	wchan_wakeall(buf_wchan);
+	return result;
+}
+
+/*
+ * Get the cached copies of NBLOCKS blocks from BLOCK on out of the way
+ * of I/O that bypasses the cache: write back the dirty ones, or if
+ * DISCARD, throw them all away. Called and returns with buf_lock held.
+ */
+static
+int
+buf_flushrange(struct device *dev, uint32_t block, uint32_t nblocks,
+	       bool discard)
+{
+	struct buf *b;
+	uint32_t i;
+	int result;
+
+	for (i = 0; i < nblocks; i++) {
+		while ((b = buf_find(dev, block + i)) != NULL) {
+			if (b->b_busy) {
+				buf_wait();
+			}
+			else if (discard) {
+				buf_unassign(b);
+			}
+			else if (b->b_dirty) {
+				result = buf_writeback(b);
+				if (result) {
+					return result;
+				}
+			}
+			else {
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Find the least recently used idle buffer of the right size. If there
+ * is none, *ANYBUSY says whether waiting for one might help.
+ */
+static
+struct buf *
+buf_victim(size_t size, bool *anybusy)
+{
+	struct buf *b;
+
+	*anybusy = false;
+	for (b = buf_lrutail; b != NULL; b = b->b_lruprev) {
+		if (b->b_size != size) {
+			continue;
+		}
+		if (!b->b_busy) {
+			return b;
+		}
+		*anybusy = true;
+	}
+	return NULL;
+}
+
+/*
+ * Common code for buf_read and buf_get.
+ */
+static
+int
+buf_lookup(struct device *dev, uint32_t block, bool doread, struct buf **ret)
+{
+	size_t size = dev->d_blocksize;
+	struct buf *b;
+	bool cangrow = true;
+	bool anybusy;
+	int result;
+
+	spinlock_acquire(&buf_lock);
+
+ again:
+	b = buf_find(dev, block);
+	if (b != NULL) {
+		if (b->b_busy) {
+			buf_wait();
+			goto again;
+		}
+		if (b->b_valid) {
+			buf_stat_hits++;
+		}
+		else {
+			buf_stat_misses++;
+		}
+	}
+	else {
+		/* Let the limit come back up if memory allows. */
+		if (buf_bytes + size > buf_limit && buf_limit < buf_maxbytes
+		    && vm_freepages() * PAGE_SIZE > buf_maxbytes) {
+			buf_limit += size;
+		}
+
+		if (cangrow && buf_bytes + size <= buf_limit) {
+			/* Room for another buffer. kmalloc may sleep. */
+			buf_bytes += size;
+			spinlock_release(&buf_lock);
+			b = buf_create(size);
+			spinlock_acquire(&buf_lock);
+			if (b == NULL) {
+				buf_bytes -= size;
+				cangrow = false;
+			}
+			else {
+				buf_count++;
+				buf_lruinsert(b, false);
+			}
+			goto again;
+		}
+
+		b = buf_victim(size, &anybusy);
+		if (b == NULL) {
+			if (!anybusy) {
+				spinlock_release(&buf_lock);
+				return ENOMEM;
+			}
+			buf_wait();
+			goto again;
+		}
+		if (b->b_dirty) {
+			result = buf_writeback(b);
+			if (result) {
+				spinlock_release(&buf_lock);
+				return result;
+			}
+			/* Things may have changed while we slept. */
+			goto again;
+		}
+
+		if (b->b_dev != NULL) {
+			buf_stat_reuses++;
+		}
+		buf_unassign(b);
+		b->b_dev = dev;
+		b->b_block = block;
+		buf_hashinsert(b);
+		buf_stat_misses++;
+	}
+
+	b->b_busy = true;
+	buf_lruremove(b);
+	buf_lruinsert(b, true);
+	spinlock_release(&buf_lock);
+
+	if (doread && !b->b_valid) {
+		result = buf_io(b, UIO_READ);
+		if (result) {
+			buf_release(b);
+			return result;
+		}
+		b->b_valid = true;
+	}
+
+	*ret = b;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Interface
+
+void
+buf_bootstrap(void)
+{
+	spinlock_init(&buf_lock);
+	buf_wchan = wchan_create("buf");
+	if (buf_wchan == NULL) {
+		panic("buf_bootstrap: Out of memory\n");
+	}
+
+	buf_maxbytes = vm_freepages() * PAGE_SIZE / BUF_MEMFRACTION;
+	if (buf_maxbytes < BUF_MINBYTES) {
+		buf_maxbytes = BUF_MINBYTES;
+	}
+	buf_limit = buf_maxbytes;
+}
+
+int
+buf_read(struct device *dev, uint32_t block, struct buf **ret)
+{
+	return buf_lookup(dev, block, true, ret);
+}
+
+int
+buf_get(struct device *dev, uint32_t block, struct buf **ret)
+{
+	return buf_lookup(dev, block, false, ret);
+}
+
+void *
+buf_data(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_data;
+}
+
+bool
+buf_isvalid(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_valid;
+}
+
+void
+buf_markdirty(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	b->b_valid = true;
+	b->b_dirty = true;
+}
+
+void
+buf_release(struct buf *b)
+{
+	spinlock_acquire(&buf_lock);
+	KASSERT(b->b_busy);
+	b->b_busy = false;
+	if (!b->b_valid) {
+		/* Nothing worth keeping; reuse it first. */
+		buf_unassign(b);
+	}
+	wchan_wakeall(buf_wchan);
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * Common code for buf_readrun and buf_writerun. The run goes through
+ * a bounce buffer rather than straight to or from the uio, so a fault
+ * on a user buffer never happens with the device held.
+ */
+static
+int
+buf_run(struct device *dev, uint32_t block, uint32_t nblocks,
+	struct uio *uio)
+{
+	size_t len = nblocks * dev->d_blocksize;
+	void *data;
+	int result;
+
+	KASSERT(nblocks > 0 && nblocks <= BUF_MAXRUN);
+	KASSERT(uio->uio_resid >= len);
+
+	data = kmalloc(len);
+	if (data == NULL) {
+		return ENOMEM;
+	}
+
+	if (uio->uio_rw == UIO_WRITE) {
+		result = uiomove(data, len, uio);
+		if (result) {
+			kfree(data);
+			return result;
+		}
+	}
+
+	/*
+	 * Reads need the disk up to date; writes make whatever is
+	 * cached stale.
+	 */
+	spinlock_acquire(&buf_lock);
+	result = buf_flushrange(dev, block, nblocks,
+				uio->uio_rw == UIO_WRITE);
+	buf_stat_runs++;
+	buf_stat_runblocks += nblocks;
+	spinlock_release(&buf_lock);
+	if (result) {
+		kfree(data);
+		return result;
+	}
+
+	result = buf_devio(dev, block, data, len, uio->uio_rw);
+	if (result == 0 && uio->uio_rw == UIO_READ) {
+		result = uiomove(data, len, uio);
+	}
+
+	kfree(data);
+	return result;
+}
+
+int
+buf_readrun(struct device *dev, uint32_t block, uint32_t nblocks,
+	    struct uio *uio)
+{
+	KASSERT(uio->uio_rw == UIO_READ);
+	return buf_run(dev, block, nblocks, uio);
+}
+
+int
+buf_writerun(struct device *dev, uint32_t block, uint32_t nblocks,
+	     struct uio *uio)
+{
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	return buf_run(dev, block, nblocks, uio);
+}
+
+/*
+ * The buffers to write are marked first, because each write drops
+ * buf_lock and the LRU list may be rearranged meanwhile; then marked
+ * buffers are written back one at a time, looking afresh each time.
+ * Buffers dirtied after we start are left for next time.
+ */
+int
+buf_sync(struct device *dev)
+{
+	struct buf *b;
+	int result, err = 0;
+
+	spinlock_acquire(&buf_lock);
+
+	for (b = buf_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_dev == dev && b->b_dirty) {
+			b->b_syncing = true;
+		}
+	}
+
+ again:
+	for (b = buf_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_dev != dev || !b->b_syncing) {
+			continue;
+		}
+		if (b->b_busy) {
+			buf_wait();
+			goto again;
+		}
+		if (b->b_dirty) {
+			result = buf_writeback(b);
+			if (result && err == 0) {
+				err = result;
+			}
+		}
+		/* Cleared only now, so a concurrent sync waits for it. */
+		b->b_syncing = false;
+		goto again;
+	}
+
+	spinlock_release(&buf_lock);
+	return err;
+}
+
+void
+buf_forget(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	spinlock_acquire(&buf_lock);
+	while ((b = buf_find(dev, block)) != NULL && b->b_busy) {
+		buf_wait();
+	}
+	if (b != NULL) {
+		buf_unassign(b);
+	}
+	spinlock_release(&buf_lock);
+}
+
+void
+buf_dropdev(struct device *dev)
+{
+	struct buf *b, *next;
+
+	spinlock_acquire(&buf_lock);
+
+ again:
+	for (b = buf_lruhead; b != NULL; b = next) {
+		next = b->b_lrunext;
+		if (b->b_dev != dev) {
+			continue;
+		}
+		if (b->b_busy) {
+			buf_wait();
+			goto again;
+		}
+		buf_unassign(b);
+	}
+
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * Called by the pageout daemon. Buffers are freed one at a time with
+ * kfree, so the pages come back as kmalloc finds them empty.
+ */
+unsigned
+buf_reclaim(unsigned npages)
+{
+	struct buf *b, *prev, *freelist;
+	size_t want, got;
+	unsigned n;
+
+	want = npages * PAGE_SIZE;
+	got = 0;
+	n = 0;
+	freelist = NULL;
+
+	spinlock_acquire(&buf_lock);
+	for (b = buf_lrutail; b != NULL && got < want; b = prev) {
+		prev = b->b_lruprev;
+		if (b->b_busy || b->b_dirty) {
+			continue;
+		}
+		if (buf_bytes - b->b_size < BUF_MINBYTES) {
+			break;
+		}
+		if (b->b_dev != NULL) {
+			buf_hashremove(b);
+		}
+		buf_lruremove(b);
+		buf_bytes -= b->b_size;
+		buf_count--;
+		got += b->b_size;
+		n++;
+		b->b_lrunext = freelist;
+		freelist = b;
+	}
+	if (n > 0) {
+		buf_limit = buf_bytes;
+		buf_stat_reclaimed += n;
+	}
+	spinlock_release(&buf_lock);
+
+	while (freelist != NULL) {
+		b = freelist;
+		freelist = b->b_lrunext;
+		buf_destroy(b);
+	}
+
+	return n;
+}
+
+void
+buf_printstats(void)
+{
+	unsigned count, dirty, busy;
+	size_t bytes, limit, maxbytes;
+	uint32_t hits, misses, reads, writes, reuses, reclaimed;
+	uint32_t runs, runblocks;
+	struct buf *b;
+
+	dirty = busy = 0;
+
+	spinlock_acquire(&buf_lock);
+	for (b = buf_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_dirty) {
+			dirty++;
+		}
+		if (b->b_busy) {
+			busy++;
+		}
+	}
+	count = buf_count;
+	bytes = buf_bytes;
+	limit = buf_limit;
+	maxbytes = buf_maxbytes;
+	hits = buf_stat_hits;
+	misses = buf_stat_misses;
+	reads = buf_stat_reads;
+	writes = buf_stat_writes;
+	reuses = buf_stat_reuses;
+	reclaimed = buf_stat_reclaimed;
+	runs = buf_stat_runs;
+	runblocks = buf_stat_runblocks;
+	spinlock_release(&buf_lock);
+
+	kprintf("Buffer cache: %u buffers (%u dirty, %u busy), "
+		"%uk of %uk (max %uk)\n", count, dirty, busy,
+		bytes / 1024, limit / 1024, maxbytes / 1024);
+	kprintf("  hits: %lu  misses: %lu  reads: %lu  writes: %lu\n",
+		(unsigned long)hits, (unsigned long)misses,
+		(unsigned long)reads, (unsigned long)writes);
+	kprintf("  reused: %lu  reclaimed: %lu\n",
+		(unsigned long)reuses, (unsigned long)reclaimed);
+	kprintf("  uncached runs: %lu (%lu blocks)\n",
+		(unsigned long)runs, (unsigned long)runblocks);
+}
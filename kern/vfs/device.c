@@ -241,15 +241,17 @@ null_fsync(struct vnode *v)
 }
 
 /*
- * For mmap. If you want this to do anything, you have to write it
- * yourself. Some devices may not make sense to map. Others do.
+ * For mmap. None of our devices make sense to map, so this always
+ * fails.
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v, off_t offset, size_t len)
 {
 	(void)v;
-	return EUNIMP;
+	(void)offset;
+	(void)len;
+	return ENODEV;
 }
 
 /*
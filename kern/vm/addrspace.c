@@ -44,6 +44,129 @@
 #include <machine/coremap.h>
 #include <array.h>
 
+// fault-around
+// - a fault reads the swapped-out pages of the aligned window of
+//   as_farpages pages around it in with one swap request, and maps
+//   the resident ones into free TLB slots
+// - 0 or 1 turns it off
+static unsigned as_farpages = 8;
+static uint32_t as_stat_farfaults;	/* faults that looked around */
+static uint32_t as_stat_farmapped;	/* neighbours mapped ahead */
+static uint32_t as_stat_farread;	/* pages read in batches */
+
+// as_objects is kept sorted by base, and the regions' guard bands and
+// pages never overlap, so a fault finds its region by binary search
+// when it misses as_lastvmo.
+
+// Finds the First Region Based above va.
+static unsigned
+as_search (struct addrspace *as, vaddr_t va)
+{
+
+	struct vm_object *vmo = NULL;
+	unsigned lo; unsigned hi; unsigned mid;
+
+	lo = 0;
+	hi = array_num(as -> as_objects);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		vmo = array_get(as -> as_objects, mid);
+		if (vmo -> base <= va) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return (lo);
+
+}
+
+// Finds the Region Holding va.
+// - returns NULL if va isn't in any region
+static struct vm_object *
+as_lookup (struct addrspace *as, vaddr_t va)
+{
+
+	struct vm_object *vmo = NULL;
+	unsigned i;
+
+	// most faults land in the same region as the last one
+	vmo = as -> as_lastvmo;
+	if (vmo != NULL && va >= vmo -> base &&
+	    va < vmo -> base + PAGE_SIZE * array_num(vmo -> lpages)) {
+		return (vmo);
+	}
+
+	i = as_search(as, va);
+	if (i == 0) {
+		return (NULL);
+	}
+	vmo = array_get(as -> as_objects, i - 1);
+	if (va >= vmo -> base + PAGE_SIZE * array_num(vmo -> lpages)) {
+		return (NULL);
+	}
+
+	as -> as_lastvmo = vmo;
+	return (vmo);
+
+}
+
+// Checks if [bot, top) Overlaps a Region or its Guard Band.
+static int
+as_overlaps (struct addrspace *as, vaddr_t bot, vaddr_t top)
+{
+
+	struct vm_object *vmo = NULL;
+	unsigned i;
+
+	i = as_search(as, bot);
+
+	// the region based at or below bot
+	if (i > 0) {
+		vmo = array_get(as -> as_objects, i - 1);
+		if (vmo -> base + PAGE_SIZE * array_num(vmo -> lpages) > bot) {
+			return (1);
+		}
+	}
+
+	// the region based above bot
+	if (i < array_num(as -> as_objects)) {
+		vmo = array_get(as -> as_objects, i);
+		if (vmo -> base - vmo -> redzone < top) {
+			return (1);
+		}
+	}
+
+	return (0);
+
+}
+
+// Adds a Region, Keeping as_objects Sorted.
+static int
+as_insert (struct addrspace *as, struct vm_object *vmo)
+{
+
+	unsigned i; unsigned n;
+	int result;
+
+	i = as_search(as, vmo -> base);
+
+	result = array_add(as -> as_objects, vmo, &n);
+	if (result) {
+		return (result);
+	}
+	for (; n > i; n--) {
+		array_set(as -> as_objects, n,
+			  array_get(as -> as_objects, n - 1));
+	}
+	array_set(as -> as_objects, i, vmo);
+
+	return (0);
+
+}
+
 // Creates an Address Space.
 struct addrspace *
 as_create (void)
@@ -62,6 +185,19 @@ as_create (void)
 		return (NULL);
 	}
 
+	as -> as_lastvmo = NULL;
+
+	// created by as_complete_load
+	as -> as_heap = NULL;
+	as -> as_heapbreak = 0;
+
+	// assigned by the MMU on first activation
+	as -> as_asid = 0;
+	as -> as_asidgen = 0;
+	as -> as_cpus = 0;
+	as -> as_tlbbatch = 0;
+	as -> as_tlbwait = 0;
+
 	return (as);
 
 }
@@ -87,12 +223,12 @@ as_copy (struct addrspace *srcaddr, struct addrspace **ret)
 
 	KASSERT(srcaddr == curthread -> t_addrspace);
 
-	// copy the vm_objects
+	// copy the vm_objects, which stay sorted
 	for (i = 0; (unsigned)i < array_num(srcaddr -> as_objects); i++) {
 	
 		vmo = array_get(srcaddr -> as_objects, i);
 
-		result = vmo_copy(vmo, dstaddr, &newvmo);
+		result = vmo_copy(vmo, srcaddr, dstaddr, &newvmo);
 		if (result) {
 			as_destroy(dstaddr);
 			return (result);
@@ -105,55 +241,245 @@ as_copy (struct addrspace *srcaddr, struct addrspace **ret)
 			return (result);
 		}
 
+		if (vmo == srcaddr -> as_heap) {
+			dstaddr -> as_heap = newvmo;
+		}
+
 	}
 
+	dstaddr -> as_heapbreak = srcaddr -> as_heapbreak;
+
 	*ret = dstaddr;
 	return (0);
 
 }
 
-// Handles a Fault.
-int
-as_fault (struct addrspace *as, int faulttype, vaddr_t va)
+// Finds the Fault-Around Window for a Page of a Region.
+// - returns 0 if fault-around is off
+static int
+as_farwindow (struct vm_object *vmo, unsigned index, unsigned *first,
+	      unsigned *last)
 {
 
-	struct vm_object *faultvmo = NULL;
-	struct lpage *lp = NULL;
-	vaddr_t bot; vaddr_t top;
-	int i; int index; int result;
+	unsigned far;
 
-	DEBUG(DB_VM, "Addrspace: as_fault\n");
+	far = as_farpages;
+	if (far <= 1) {
+		return (0);
+	}
 
-	bot = 0;
+	*first = index & ~(far - 1);
+	*last = *first + far;
+	if (*last > array_num(vmo -> lpages)) {
+		*last = array_num(vmo -> lpages);
+	}
+	return (1);
 
-	// find vm_object
-	for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
-		
-		struct vm_object *vmo = NULL;
+}
 
-		vmo = array_get(as -> as_objects, i);
-		bot = vmo -> base;
-		top = bot + PAGE_SIZE * array_num(vmo -> lpages);
-		if (va >= bot && va < top) {
-			faultvmo = vmo;
+// Reads a Faulting Page and its Swapped-Out Neighbours in Together.
+// - pages never touched are left alone, so no zero-fill or file read
+//   is ever speculative
+static void
+as_readaround (struct vm_object *vmo, unsigned index)
+{
+
+	struct lpage *lps[SWAP_MAXRUN];
+	struct lpage *lp;
+	unsigned first; unsigned last;
+	unsigned i; unsigned n; unsigned read;
+	int spl;
+
+	if (!as_farwindow(vmo, index, &first, &last)) {
+		return;
+	}
+
+	n = 0;
+	for (i = first; i < last; i++) {
+		lp = array_get(vmo -> lpages, i);
+		if (lp != NULL) {
+			lps[n++] = lp;
+		}
+	}
+	if (n <= 1) {
+		return;
+	}
+
+	read = lp_prefetch(lps, n);
+
+	spl = splhigh();
+	as_stat_farread += read;
+	splx(spl);
+
+}
+
+// Maps a Fault's Resident Neighbours Ahead of Use.
+// - stops once the TLB has no free slot, so it never pushes out
+//   entries the process is using
+static void
+as_faultaround (struct addrspace *as, struct vm_object *vmo, unsigned index)
+{
+
+	struct lpage *lp;
+	unsigned first; unsigned last;
+	unsigned i; unsigned mapped;
+	int spl; int result;
+
+	if (!as_farwindow(vmo, index, &first, &last)) {
+		return;
+	}
+
+	mapped = 0;
+	for (i = first; i < last; i++) {
+		lp = array_get(vmo -> lpages, i);
+		if (i == index || lp == NULL) {
+			continue;
+		}
+		result = lp_prefault(lp, as, vmo -> base + i * PAGE_SIZE,
+				     vmo -> perms & VMO_W, vmo -> shared);
+		if (result == ENOSPC) {
 			break;
 		}
+		if (result == 0) {
+			mapped++;
+		}
+	}
+
+	spl = splhigh();
+	as_stat_farfaults++;
+	as_stat_farmapped += mapped;
+	splx(spl);
+
+}
+
+// Sets the Fault-Around Window.
+// - npages must be a power of two no bigger than SWAP_MAXRUN; 0 or 1
+//   turns fault-around off
+// - the statistics start over
+int
+as_setfaultaround (unsigned npages)
+{
+
+	int spl;
 
+	if (npages > SWAP_MAXRUN || (npages & (npages - 1)) != 0) {
+		return (EINVAL);
 	}
 
+	spl = splhigh();
+	as_farpages = npages;
+	as_stat_farfaults = 0;
+	as_stat_farmapped = 0;
+	as_stat_farread = 0;
+	splx(spl);
+
+	return (0);
+
+}
+
+// Prints Fault-Around Statistics.
+// - MIPS has no referenced bit, so we can't tell which neighbours were
+//   used; faults avoided is at most the number mapped
+void
+as_printfaultstats (void)
+{
+
+	uint32_t faults; uint32_t mapped; uint32_t read;
+	unsigned far;
+	int spl;
+
+	spl = splhigh();
+	far = as_farpages;
+	faults = as_stat_farfaults;
+	mapped = as_stat_farmapped;
+	read = as_stat_farread;
+	splx(spl);
+
+	kprintf("Fault-around window: %u pages\n", far);
+	kprintf("  faults looked around: %lu\n", (unsigned long)faults);
+	kprintf("  neighbours mapped:    %lu (faults avoided, at most)\n",
+		(unsigned long)mapped);
+	kprintf("  pages read in batches: %lu\n", (unsigned long)read);
+
+}
+
+// Handles a Fault.
+// - most faults are TLB refills of resident pages; only one that has
+//   to bring its page in (from swap or the backing file, or by
+//   zero-filling) reads and maps its neighbours too
+int
+as_fault (struct addrspace *as, int faulttype, vaddr_t va)
+{
+
+	struct vm_object *faultvmo = NULL;
+	struct lpage *lp = NULL;
+	int index; int result; int major;
+
+	DEBUG(DB_VM, "Addrspace: as_fault\n");
+
+	faultvmo = as_lookup(as, va);
 	if (faultvmo == NULL) {
 		return (EFAULT);
 	}
 
-	index = (va - bot) / PAGE_SIZE;
+	// text and read-only data
+	if (faulttype != VM_FAULT_READ && !(faultvmo -> perms & VMO_W)) {
+		return (EFAULT);
+	}
+
+	index = (va - faultvmo -> base) / PAGE_SIZE;
 	lp = array_get(faultvmo -> lpages, index);
 
+	major = (lp == NULL || !lp_isresident(lp));
+	if (major) {
+		as_readaround(faultvmo, index);
+	}
+
+	if (lp == NULL && faulttype == VM_FAULT_READ) {
+		// looking at an untouched page needn't allocate one
+		if (vmo_mapzero(as, faultvmo, index) == 0) {
+			return (0);
+		}
+	}
+
 	if (lp == NULL) {
-		result = lp_zero(&lp);
+		if (faultvmo -> zeromapped) {
+			// may be read-only on the zero frame, here or elsewhere
+			mmu_unmap(as, va);
+		}
+		result = vmo_fill(faultvmo, index, &lp);
+		if (result) {
+			return (result);
+		}
 		array_set(faultvmo -> lpages, index, lp);
 	}
+	else if (faulttype != VM_FAULT_READ && !faultvmo -> shared &&
+		 lp_isshared(lp)) {
+
+		struct lpage *newlp = NULL;
+
+		// copy-on-write: take a private copy and drop our share
+		result = lp_copy(lp, &newlp);
+		if (result) {
+			return (result);
+		}
+		array_set(faultvmo -> lpages, index, newlp);
+		mmu_unmap(as, va);
+		lp_destroy(lp);
+		lp = newlp;
+
+	}
 	
-	return (lp_fault(lp, as, faulttype, va));
+	result = lp_fault(lp, as, faulttype, va, faultvmo -> perms & VMO_W,
+			  faultvmo -> shared);
+	if (result) {
+		return (result);
+	}
+
+	if (major) {
+		as_faultaround(as, faultvmo, index);
+	}
+	return (0);
 
 }
 
@@ -175,9 +501,10 @@ as_activate (struct addrspace *as)
  * VADDR+MEMSIZE.
  *
  * The READABLE, WRITEABLE, and EXECUTABLE flags are set if read,
- * write, or execute permission should be set on the segment. At the
- * moment, these are ignored. When you write the VM system, you may
- * want to implement them.
+ * write, or execute permission should be set on the segment. Writes
+ * to a region without WRITEABLE fault with EFAULT; the MIPS TLB can't
+ * refuse reads or instruction fetches, so the other two are only
+ * recorded.
  */
 int
 as_define_region (struct addrspace *as, vaddr_t vaddr, size_t sz,
@@ -186,15 +513,10 @@ as_define_region (struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 	struct vm_object *vmo = NULL;
 	vaddr_t check_vaddr;
-	unsigned *addindex = NULL;
-	int i; int result;
+	int result;
 
 	DEBUG(DB_VM, "Addrspace: as_define_region\n");
 
-	(void)readable;
-	(void)writeable;
-	(void)executable;
-
 	sz += vaddr & ~(vaddr_t)PAGE_FRAME;
 	vaddr &= PAGE_FRAME;
 	sz = (sz + PAGE_SIZE - 1) & PAGE_FRAME;
@@ -211,25 +533,9 @@ as_define_region (struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 	sz = ROUNDUP(sz, PAGE_SIZE);
 
-	// check for overlaps
-	for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
-
-		vaddr_t bot; vaddr_t top;
-		
-		vmo = array_get(as -> as_objects, i);
-		KASSERT(vmo != NULL);
-		bot = vmo -> base;
-		top = bot + PAGE_SIZE * array_num(vmo -> lpages);
-
-		// check guard band
-		KASSERT(bot >= vmo -> redzone);
-		bot = bot - vmo -> redzone;
-
-		// overlap
-		if (check_vaddr + sz > bot && check_vaddr < top) {
-			return (EINVAL);
-		}
-
+	// check for overlaps, guard bands included
+	if (as_overlaps(as, check_vaddr, vaddr + sz)) {
+		return (EINVAL);
 	}
 
 	// create new vmo
@@ -239,9 +545,11 @@ as_define_region (struct addrspace *as, vaddr_t vaddr, size_t sz,
 	}
 	vmo -> base = vaddr;
 	vmo -> redzone = USERSTACKREDZONE;
+	vmo -> perms = (readable ? VMO_R : 0) | (writeable ? VMO_W : 0) |
+		       (executable ? VMO_X : 0);
 
 	// add new vmo to parent address space
-	result = array_add(as -> as_objects, vmo, addindex);
+	result = as_insert(as, vmo);
 	if (result) {
 		vmo_destroy(as, vmo);
 		return (result);
@@ -251,6 +559,33 @@ as_define_region (struct addrspace *as, vaddr_t vaddr, size_t sz,
 
 }
 
+// Backs the Region holding vaddr with part of an Executable.
+// - called by load_elf in place of reading the segment, so its pages
+//   are only read when they are first touched
+int
+as_define_file (struct addrspace *as, vaddr_t vaddr, size_t filesize,
+		struct vnode *vn, off_t offset, int shared)
+{
+
+	struct vm_object *vmo = NULL;
+	vaddr_t top;
+
+	DEBUG(DB_VM, "Addrspace: as_define_file\n");
+
+	vmo = as_lookup(as, vaddr);
+	if (vmo == NULL) {
+		return (EFAULT);
+	}
+
+	top = vmo -> base + PAGE_SIZE * array_num(vmo -> lpages);
+	if (vaddr + filesize > top) {
+		return (EINVAL);
+	}
+
+	return (vmo_setfile(vmo, vn, offset, vaddr, filesize, shared));
+
+}
+
 int
 as_prepare_load (struct addrspace *as)
 {
@@ -259,12 +594,48 @@ as_prepare_load (struct addrspace *as)
 	return (0);
 }
 
+// Finishes Loading an Executable.
+// - the heap starts out empty on the first page above the segments
 int
 as_complete_load (struct addrspace *as)
 {
+
+	struct vm_object *vmo = NULL;
+	vaddr_t heapbase; vaddr_t top;
+	int i; int result;
+
 	DEBUG(DB_VM, "Addrspace: as_complete_load\n");
-	(void)as;
+
+	KASSERT(as -> as_heap == NULL);
+
+	heapbase = 0;
+	for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
+		vmo = array_get(as -> as_objects, i);
+		top = vmo -> base + PAGE_SIZE * array_num(vmo -> lpages);
+		if (top > heapbase) {
+			heapbase = top;
+		}
+	}
+
+	vmo = vmo_create(0);
+	if (vmo == NULL) {
+		return (ENOMEM);
+	}
+	vmo -> base = heapbase;
+	vmo -> redzone = 0;
+	vmo -> perms = VMO_R | VMO_W;
+
+	result = as_insert(as, vmo);
+	if (result) {
+		vmo_destroy(as, vmo);
+		return (result);
+	}
+
+	as -> as_heap = vmo;
+	as -> as_heapbreak = heapbase;
+
 	return (0);
+
 }
 
 // Defines User-Level Stack.
@@ -289,6 +660,227 @@ as_define_stack (struct addrspace *as, vaddr_t *stackptr)
 
 }
 
+// Moves the Heap Break.
+// - pages are added empty and zero-filled when first touched; pages
+//   the break drops below are freed
+// - the heap may not grow into the redzone of the region above it
+int
+as_sbrk (struct addrspace *as, intptr_t amount, vaddr_t *oldbreak)
+{
+
+	struct vm_object *heap = NULL;
+	struct vm_object *vmo = NULL;
+	vaddr_t newbreak; vaddr_t limit; vaddr_t bot;
+	int i; int result;
+
+	DEBUG(DB_VM, "Addrspace: as_sbrk: amount = %d\n", (int)amount);
+
+	heap = as -> as_heap;
+	if (heap == NULL) {
+		return (ENOMEM);
+	}
+
+	newbreak = as -> as_heapbreak + amount;
+	if (amount < 0 && newbreak > as -> as_heapbreak) {
+		return (EINVAL);
+	}
+	if (amount > 0 && newbreak < as -> as_heapbreak) {
+		return (ENOMEM);
+	}
+	if (newbreak < heap -> base) {
+		return (EINVAL);
+	}
+
+	// lowest guard band above the heap
+	limit = USERSPACETOP;
+	for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
+		vmo = array_get(as -> as_objects, i);
+		if (vmo == heap || vmo -> base < heap -> base) {
+			continue;
+		}
+		bot = vmo -> base - vmo -> redzone;
+		if (bot < limit) {
+			limit = bot;
+		}
+	}
+	if (ROUNDUP(newbreak, PAGE_SIZE) > limit) {
+		return (ENOMEM);
+	}
+
+	result = vmo_resize(as, heap,
+			    (ROUNDUP(newbreak, PAGE_SIZE) - heap -> base) / PAGE_SIZE);
+	if (result) {
+		return (result);
+	}
+
+	*oldbreak = as -> as_heapbreak;
+	as -> as_heapbreak = newbreak;
+
+	return (0);
+
+}
+
+// Maps Part of a File into an Address Space.
+// - the mapping goes in the highest gap below the stack that fits it
+//   and a guard band, so the heap can grow up towards it
+// - perms are VMO_* bits; shared picks MAP_SHARED over MAP_PRIVATE
+int
+as_mmap (struct addrspace *as, size_t len, int perms, struct vnode *vn,
+	 off_t offset, off_t filesize, int shared, vaddr_t *ret)
+{
+
+	struct vm_object *vmo = NULL;
+	vaddr_t bot; vaddr_t top;
+	vaddr_t vbot; vaddr_t vtop;
+	size_t sz;
+	int i; int moved; int result;
+
+	DEBUG(DB_VM, "Addrspace: as_mmap: len = %u\n", len);
+
+	KASSERT(offset % PAGE_SIZE == 0);
+
+	sz = ROUNDUP(len, PAGE_SIZE);
+	if (sz == 0) {
+		return (EINVAL);
+	}
+
+	// slide down past every region we overlap
+	top = USERSPACETOP;
+	do {
+
+		moved = 0;
+		if (top < sz + USERSTACKREDZONE) {
+			return (ENOMEM);
+		}
+		bot = top - sz;
+
+		for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
+			vmo = array_get(as -> as_objects, i);
+			vbot = vmo -> base - vmo -> redzone;
+			vtop = vmo -> base + PAGE_SIZE * array_num(vmo -> lpages);
+			if (bot - USERSTACKREDZONE < vtop && top > vbot) {
+				top = vbot;
+				moved = 1;
+				break;
+			}
+		}
+
+	} while (moved);
+
+	vmo = vmo_create(sz / PAGE_SIZE);
+	if (vmo == NULL) {
+		return (ENOMEM);
+	}
+	vmo -> base = bot;
+	vmo -> redzone = USERSTACKREDZONE;
+	vmo -> perms = perms;
+
+	result = vmo_setmap(vmo, vn, offset, filesize, shared);
+	if (result) {
+		vmo_destroy(as, vmo);
+		return (result);
+	}
+
+	result = as_insert(as, vmo);
+	if (result) {
+		vmo_destroy(as, vmo);
+		return (result);
+	}
+
+	*ret = bot;
+	return (0);
+
+}
+
+// Removes a Mapping made by as_mmap.
+// - only whole mappings can be removed; a MAP_SHARED one is written
+//   back first
+int
+as_munmap (struct addrspace *as, vaddr_t vaddr, size_t len)
+{
+
+	struct vm_object *vmo = NULL;
+	int i;
+
+	DEBUG(DB_VM, "Addrspace: as_munmap: vaddr = %x\n", vaddr);
+
+	for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
+
+		vmo = array_get(as -> as_objects, i);
+		if (vmo -> file == NULL || vmo -> base != vaddr) {
+			continue;
+		}
+		if (ROUNDUP(len, PAGE_SIZE) !=
+		    PAGE_SIZE * array_num(vmo -> lpages)) {
+			return (EINVAL);
+		}
+
+		array_remove(as -> as_objects, i);
+		if (as -> as_lastvmo == vmo) {
+			as -> as_lastvmo = NULL;
+		}
+		vmo_destroy(as, vmo);
+		return (0);
+
+	}
+
+	return (EINVAL);
+
+}
+
+// Writes MAP_SHARED Pages in a Range back to their Files.
+// - private mappings and ordinary regions in the range are skipped
+int
+as_msync (struct addrspace *as, vaddr_t vaddr, size_t len)
+{
+
+	struct vm_object *vmo = NULL;
+	vaddr_t bot; vaddr_t top; vaddr_t end;
+	vaddr_t lo; vaddr_t hi;
+	int i; int found; int result; int err;
+
+	DEBUG(DB_VM, "Addrspace: as_msync: vaddr = %x, len = %u\n", vaddr, len);
+
+	if (vaddr % PAGE_SIZE != 0) {
+		return (EINVAL);
+	}
+	end = vaddr + ROUNDUP(len, PAGE_SIZE);
+	if (end < vaddr) {
+		return (ENOMEM);
+	}
+
+	found = 0; err = 0;
+	for (i = 0; (unsigned)i < array_num(as -> as_objects); i++) {
+
+		vmo = array_get(as -> as_objects, i);
+		bot = vmo -> base;
+		top = bot + PAGE_SIZE * array_num(vmo -> lpages);
+		lo = vaddr > bot ? vaddr : bot;
+		hi = end < top ? end : top;
+		if (lo >= hi) {
+			continue;
+		}
+
+		found = 1;
+		if (!vmo -> shared) {
+			continue;
+		}
+
+		result = vmo_sync(vmo, (lo - bot) / PAGE_SIZE,
+				  (hi - lo) / PAGE_SIZE);
+		if (result && err == 0) {
+			err = result;
+		}
+
+	}
+
+	if (!found) {
+		return (ENOMEM);
+	}
+	return (err);
+
+}
+
 // Destroys an Address Space.
 void
 as_destroy (struct addrspace *as)
@@ -11,9 +11,12 @@
 #include <spl.h>
 #include <synch.h>
 #include <thread.h>
+#include <uio.h>
+#include <vnode.h>
 #include <machine/coremap.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <vmstat.h>
 
 // Creates a Logical Page.
 struct lpage *
@@ -31,6 +34,8 @@ lp_create (void)
 
 	lp -> swapaddr = INVALID_SWAPADDR;
 	lp -> paddr = INVALID_PADDR;
+	lp -> refcount = 1;
+	lp -> mapdirty = 0;
 
 	lp -> lock = lock_create("lpage");
 	if (lp -> lock == NULL) {
@@ -42,40 +47,125 @@ lp_create (void)
 
 }
 
-// Creates a Logical Page and Allocates Swap & RAM.
+// Pins the Frame of a Locked Logical Page, if Resident.
+// - drops lp -> lock around each pin so we never wait on a pin holding
+//   it; the evictor holds the pin and then wants the lock
+// - the frame may be evicted or relocated meanwhile, so retry until the
+//   pinned frame is still the page's
+static void
+lp_pin (struct lpage *lp, paddr_t *paret)
+{
+
+	paddr_t pa;
+
+	KASSERT(lock_do_i_hold(lp -> lock));
+	pa = lp -> paddr & PAGE_FRAME;
+
+	while (pa != INVALID_PADDR) {
+
+		lock_release(lp -> lock);
+		cm_pin(pa);
+		lock_acquire(lp -> lock);
+
+		if ((lp -> paddr & PAGE_FRAME) == pa) {
+			break;
+		}
+
+		// evicted or moved while we waited
+		cm_unpin(pa);
+		pa = lp -> paddr & PAGE_FRAME;
+
+	}
+
+	*paret = pa;
+
+}
+
+// Locks a Logical Page and Pins its Frame, if Resident.
+static void
+lp_lock_and_pin (struct lpage *lp, paddr_t *paret)
+{
+
+	lock_acquire(lp -> lock);
+	lp_pin(lp, paret);
+
+}
+
+// Brings a Logical Page back in from Swap.
+// - lp -> lock is held and the page isn't resident, so we may allocate
+// - the swap copy is current, so the page starts out clean
 static int
-lp_setup (struct lpage **lpret, paddr_t *paret)
+lp_pagein (struct lpage *lp, paddr_t *paret)
 {
 
-	struct lpage *lp = NULL;
 	paddr_t pa;
 	off_t swa;
 
+	DEBUG(DB_VM, "LPage: lp_pagein\n");
+
+	KASSERT(lock_do_i_hold(lp -> lock));
+	KASSERT((lp -> paddr & PAGE_FRAME) == INVALID_PADDR);
+
+	swa = lp -> swapaddr;
+	KASSERT(swa != INVALID_SWAPADDR);
+
+	pa = cm_allocuserpage(lp);
+	if (pa == INVALID_PADDR) {
+		return (ENOMEM);
+	}
+	KASSERT(cm_pageispinned(pa));
+
+	swap_pagein(pa, swa);
+
+	KASSERT((lp -> paddr & PAGE_FRAME) == INVALID_PADDR);
+	lp -> paddr = pa | LPF_LOCKED;
+
+	*paret = pa;
+	return (0);
+
+}
+
+// Creates a Logical Page, Reserves Swap & Allocates RAM.
+// - with zero set the frame comes back zero-filled
+// - the swap slot itself waits for the first pageout; lp_destroy
+//   gives the reservation back
+static int
+lp_setup (struct lpage **lpret, paddr_t *paret, int zero)
+{
+
+	struct lpage *lp = NULL;
+	paddr_t pa;
+	int result;
+
 	DEBUG(DB_VM, "LPage: lp_setup\n");
 
+	result = swap_reserve();
+	if (result) {
+		return (result);
+	}
+
 	lp = lp_create();
 	if (lp == NULL) {
+		swap_unreserve();
 		return (ENOMEM);
 	}
 
-	swa = swap_allocate();
-	if (swa == INVALID_SWAPADDR) {
-		lp_destroy(lp);
-		return (ENOSPC);
-	}
-
 	lock_acquire(lp -> lock);
 
-	pa = cm_allocuserpage(lp);
+	if (zero) {
+		pa = cm_allocuserzero(lp);
+	}
+	else {
+		pa = cm_allocuserpage(lp);
+	}
 	if (pa == INVALID_PADDR) {
-		swap_deallocate(swa);
 		lock_release(lp -> lock);
 		lp_destroy(lp);
 		return (ENOSPC);
 	}
 
+	// never written out, so only RAM has it
 	lp -> paddr = pa | LPF_DIRTY | LPF_LOCKED;
-	lp -> swapaddr = swa;
 
 	KASSERT(cm_pageispinned(pa));
 
@@ -93,43 +183,25 @@ lp_copy (struct lpage *fromlp, struct lpage **tolp)
 
 	struct lpage *newlp = NULL;
 	paddr_t frompa; paddr_t topa;
-	off_t swapaddr;
 	int result;
 
 	DEBUG(DB_VM, "LPage: lp_copy\n");
 
-	lock_acquire(fromlp -> lock);
+	lp_lock_and_pin(fromlp, &frompa);
 
-	frompa = fromlp -> paddr & PAGE_FRAME;
 	if (frompa == INVALID_PADDR) {
-
-		swapaddr = fromlp -> swapaddr;
-		lock_release(fromlp -> lock);
-
-		frompa = cm_allocuserpage(fromlp);
-		if (frompa == INVALID_PADDR) {
-			return (ENOMEM);
+		// not resident, so we may allocate holding the lock, as
+		// lp_fault does; holding it, no sharer can page it in first
+		result = lp_pagein(fromlp, &frompa);
+		if (result) {
+			lock_release(fromlp -> lock);
+			return (result);
 		}
-
-		KASSERT(cm_pageispinned(frompa));
-
-		lock_acquire(paging_lock);
-		swap_pagein(frompa, swapaddr);
-		lock_acquire(fromlp -> lock);
-		lock_release(paging_lock);
-
-		KASSERT((fromlp -> paddr & PAGE_FRAME) == INVALID_PADDR);
-
-		fromlp -> paddr = frompa | LPF_LOCKED;
-
-	}
-	else {
-		cm_pin(frompa);
 	}
 
 	KASSERT(cm_pageispinned(frompa));
 
-	result = lp_setup(&newlp, &topa);
+	result = lp_setup(&newlp, &topa, 0);
 	if (result) {
 		cm_unpin(frompa);
 		lock_release(fromlp -> lock);
@@ -139,6 +211,7 @@ lp_copy (struct lpage *fromlp, struct lpage **tolp)
 	KASSERT(cm_pageispinned(topa));
 	KASSERT(cm_pageispinned(frompa));
 	cm_copypage(frompa, topa);
+	vmstat_inc(VMS_COWCOPIES);
 	cm_unpin(topa);
 	cm_unpin(frompa);
 
@@ -150,27 +223,344 @@ lp_copy (struct lpage *fromlp, struct lpage **tolp)
 
 }
 
+// Adds a Copy-on-Write Reference to a Logical Page.
+// - the page is copied by the first write fault through any sharer
+void
+lp_share (struct lpage *lp)
+{
+
+	DEBUG(DB_VM, "LPage: lp_share\n");
+
+	lock_acquire(lp -> lock);
+	KASSERT(lp -> refcount > 0);
+	lp -> refcount++;
+	lock_release(lp -> lock);
+
+}
+
+// Checks if a Logical Page has more than one Reference.
 int
-lp_fault (struct lpage *lp, struct addrspace *as, int faulttype, vaddr_t va)
+lp_isshared (struct lpage *lp)
 {
 
-	DEBUG(DB_VM, "LPage: lp_fault\n");
+	int rv;
+
+	lock_acquire(lp -> lock);
+	KASSERT(lp -> refcount > 0);
+	rv = lp -> refcount > 1;
+	lock_release(lp -> lock);
+
+	return (rv);
 
-	(void)lp;
-	(void)as;
-	(void)faulttype;
-	(void)va;
-	
-	return (1);
 }
 
-void
+// Checks if a Logical Page is Resident.
+// - looks without the lock, so the answer is only a hint; as_fault
+//   uses it to decide whether a fault is worth looking around
+int
+lp_isresident (struct lpage *lp)
+{
+
+	return ((lp -> paddr & PAGE_FRAME) != INVALID_PADDR);
+
+}
+
+// Handles a Fault on a Logical Page.
+// - pages it in from swap if it isn't resident
+// - a write fault marks it dirty; otherwise only a page that is already
+//   dirty is mapped writable, so the first write to a clean page traps
+//   and clean pages never need to be written back
+// - shared pages are always mapped read-only; as_fault copies them
+// - writable says whether the region allows writes at all
+// - mapshared pages belong to a MAP_SHARED mapping and are written in
+//   place however many sharers they have; they stay read-only until
+//   marked mapdirty, so lp_writeback sees every write
+int
+lp_fault (struct lpage *lp, struct addrspace *as, int faulttype, vaddr_t va,
+	  int writable, int mapshared)
+{
+
+	paddr_t pa;
+	int cow; int result;
+
+	DEBUG(DB_VM, "LPage: lp_fault: va = %x, faulttype = %d\n", va, faulttype);
+
+	KASSERT(writable || faulttype == VM_FAULT_READ);
+
+	lp_lock_and_pin(lp, &pa);
+
+	if (pa == INVALID_PADDR) {
+		// not resident, so we may allocate holding the lock
+		result = lp_pagein(lp, &pa);
+		if (result) {
+			lock_release(lp -> lock);
+			return (result);
+		}
+	}
+
+	KASSERT(cm_pageispinned(pa));
+	KASSERT(lp -> refcount > 0);
+	cow = lp -> refcount > 1 && !mapshared;
+
+	if (faulttype != VM_FAULT_READ && !cow) {
+		lp -> paddr |= LPF_DIRTY;
+		if (mapshared) {
+			lp -> mapdirty = 1;
+		}
+	}
+
+	writable = writable && !cow && (lp -> paddr & LPF_DIRTY) &&
+		   (!mapshared || lp -> mapdirty);
+	mmu_map(as, va, pa, writable);
+
+	cm_unpin(pa);
+	lock_release(lp -> lock);
+
+	return (0);
+
+}
+
+// Reads Swapped-Out Logical Pages in Ahead of Use.
+// - each page gets a frame and its paddr under its own lock, then the
+//   lock is dropped; the frame stays pinned until the data is in, so
+//   anyone faulting on it meanwhile waits in cm_pin
+// - runs of consecutive swap slots go to swap_pageinv as one request
+// - stops early when memory is short; returns the pages read
+unsigned
+lp_prefetch (struct lpage **lps, unsigned n)
+{
+
+	paddr_t pas[SWAP_MAXRUN];
+	off_t swas[SWAP_MAXRUN];
+	unsigned i; unsigned run; unsigned got;
+	paddr_t pa;
+
+	DEBUG(DB_VM, "LPage: lp_prefetch: n = %u\n", n);
+
+	KASSERT(n <= SWAP_MAXRUN);
+
+	got = 0;
+	for (i = 0; i < n; i++) {
+
+		lock_acquire(lps[i] -> lock);
+		if ((lps[i] -> paddr & PAGE_FRAME) != INVALID_PADDR ||
+		    lps[i] -> swapaddr == INVALID_SWAPADDR) {
+			lock_release(lps[i] -> lock);
+			continue;
+		}
+
+		// not resident, so we may allocate holding the lock
+		pa = cm_allocuserpage(lps[i]);
+		if (pa == INVALID_PADDR) {
+			lock_release(lps[i] -> lock);
+			break;
+		}
+		KASSERT(cm_pageispinned(pa));
+
+		lps[i] -> paddr = pa | LPF_LOCKED;
+		pas[got] = pa;
+		swas[got] = lps[i] -> swapaddr;
+		got++;
+
+		lock_release(lps[i] -> lock);
+
+	}
+
+	for (i = 0; i < got; i += run) {
+		for (run = 1; i + run < got; run++) {
+			if (swas[i + run] != swas[i] + (off_t)run * PAGE_SIZE) {
+				break;
+			}
+		}
+		swap_pageinv(&pas[i], swas[i], run);
+	}
+
+	for (i = 0; i < got; i++) {
+		cm_unpin(pas[i]);
+	}
+
+	return (got);
+
+}
+
+// Maps a Resident Logical Page Ahead of a Fault on it.
+// - never pages anything in; returns ENOENT if it isn't resident
+// - maps the page as a read fault would, so a first write still traps
+//   and dirty tracking is unaffected
+// - otherwise returns what mmu_prefault does
+int
+lp_prefault (struct lpage *lp, struct addrspace *as, vaddr_t va,
+	     int writable, int mapshared)
+{
+
+	paddr_t pa;
+	int cow; int result;
+
+	DEBUG(DB_VM, "LPage: lp_prefault: va = %x\n", va);
+
+	lp_lock_and_pin(lp, &pa);
+
+	if (pa == INVALID_PADDR) {
+		lock_release(lp -> lock);
+		return (ENOENT);
+	}
+
+	KASSERT(cm_pageispinned(pa));
+	KASSERT(lp -> refcount > 0);
+	cow = lp -> refcount > 1 && !mapshared;
+
+	writable = writable && !cow && (lp -> paddr & LPF_DIRTY) &&
+		   (!mapshared || lp -> mapdirty);
+	result = mmu_prefault(as, va, pa, writable);
+
+	cm_unpin(pa);
+	lock_release(lp -> lock);
+
+	return (result);
+
+}
+
+// Gives a Logical Page a Swap Slot, if it has none yet.
+// - a page without one has never been written out, so it is dirty
+// - returns ENOSPC if swap is full, which only overcommit allows
+static int
+lp_getslot (struct lpage *lp)
+{
+
+	off_t swa;
+
+	KASSERT(lock_do_i_hold(lp -> lock));
+
+	if (lp -> swapaddr != INVALID_SWAPADDR) {
+		return (0);
+	}
+	KASSERT(lp -> paddr & LPF_DIRTY);
+
+	swa = swap_allocate();
+	if (swa == INVALID_SWAPADDR) {
+		return (ENOSPC);
+	}
+	lp -> swapaddr = swa;
+
+	return (0);
+
+}
+
+// Evicts a Logical Page from RAM.
+// - called by the coremap with the frame pinned and paging_lock held
+// - dirty pages are written to their swap slot first, assigning one
+//   on the first pageout
+// - returns ENOSPC, leaving the page resident, if there is no slot
+int
 lp_evict (struct lpage *lp)
 {
 
+	paddr_t pa;
+	off_t swa;
+	int result;
+
 	DEBUG(DB_VM, "LPage: lp_evict\n");
-	
-	(void)lp;
+
+	KASSERT(lock_do_i_hold(paging_lock));
+
+	lock_acquire(lp -> lock);
+
+	pa = lp -> paddr & PAGE_FRAME;
+
+	KASSERT(pa != INVALID_PADDR);
+	KASSERT(cm_pageispinned(pa));
+
+	result = lp_getslot(lp);
+	if (result) {
+		lock_release(lp -> lock);
+		return (result);
+	}
+	swa = lp -> swapaddr;
+
+	if (lp -> paddr & LPF_DIRTY) {
+		lock_release(lp -> lock);
+		swap_pageout(pa, swa);
+		lock_acquire(lp -> lock);
+		KASSERT((lp -> paddr & PAGE_FRAME) == pa);
+	}
+
+	// swap copy is current; forget the frame
+	lp -> paddr = INVALID_PADDR;
+
+	lock_release(lp -> lock);
+
+	return (0);
+
+}
+
+// Writes a Dirty Logical Page to Swap without Evicting it.
+// - called by the pageout daemon with the frame pinned and out of
+//   the TLB, so any write after we clear LPF_DIRTY faults again
+// - returns 1 if the page was written
+int
+lp_clean (struct lpage *lp)
+{
+
+	paddr_t pa;
+	off_t swa;
+
+	DEBUG(DB_VM, "LPage: lp_clean\n");
+
+	lock_acquire(lp -> lock);
+
+	pa = lp -> paddr & PAGE_FRAME;
+
+	KASSERT(pa != INVALID_PADDR);
+	KASSERT(cm_pageispinned(pa));
+
+	if (!(lp -> paddr & LPF_DIRTY)) {
+		lock_release(lp -> lock);
+		return (0);
+	}
+
+	// out of swap; leave it to be written when there is room
+	if (lp_getslot(lp)) {
+		lock_release(lp -> lock);
+		return (0);
+	}
+	swa = lp -> swapaddr;
+
+	lp -> paddr &= ~(paddr_t)LPF_DIRTY;
+	lock_release(lp -> lock);
+
+	swap_pageout(pa, swa);
+
+	return (1);
+
+}
+
+// Moves a Resident Logical Page to Another Frame.
+// - called by the coremap with both frames pinned, the old one out of
+//   the TLB, and paging_lock held; the contents and flags come along
+void
+lp_move (struct lpage *lp, paddr_t newpa)
+{
+
+	paddr_t pa;
+
+	DEBUG(DB_VM, "LPage: lp_move\n");
+
+	KASSERT(lock_do_i_hold(paging_lock));
+	KASSERT((newpa & PAGE_FRAME) == newpa);
+
+	lock_acquire(lp -> lock);
+
+	pa = lp -> paddr & PAGE_FRAME;
+
+	KASSERT(pa != INVALID_PADDR);
+	KASSERT(pa != newpa);
+	KASSERT(cm_pageispinned(pa));
+	KASSERT(cm_pageispinned(newpa));
+
+	cm_copypage(pa, newpa);
+	lp -> paddr = newpa | (lp -> paddr & LPF_MASK);
+
+	lock_release(lp -> lock);
 
 }
 
@@ -184,25 +574,179 @@ lp_zero (struct lpage **lpret) {
 
 	DEBUG(DB_VM, "LPage: lp_zero\n");
 
-	result = lp_setup(&lp, &pa);
+	result = lp_setup(&lp, &pa, 1);
 	if (result) {
 		return (result);
 	}
 	KASSERT(lock_do_i_hold(lp -> lock));
 	KASSERT(cm_pageispinned(pa));
+	vmstat_inc(VMS_ZEROFILLS);
 
-	cm_zero(pa);
+	cm_unpin(pa);
+	lock_release(lp -> lock);
+
+	*lpret = lp;
+	return (0);
+
+}
+
+// Creates a Logical Page Filled from a File.
+// - len bytes at offset go to pgoff within the page; the rest is zero
+int
+lp_fill (struct lpage **lpret, struct vnode *vn, off_t offset,
+	 size_t pgoff, size_t len)
+{
+
+	struct lpage *lp = NULL;
+	struct iovec iov;
+	struct uio u;
+	paddr_t pa;
+	int result;
+
+	DEBUG(DB_VM, "LPage: lp_fill: offset = %llu, len = %u\n",
+	      (unsigned long long)offset, len);
+
+	KASSERT(pgoff + len <= PAGE_SIZE);
+
+	result = lp_setup(&lp, &pa, 1);
+	if (result) {
+		return (result);
+	}
+	KASSERT(lock_do_i_hold(lp -> lock));
+	KASSERT(cm_pageispinned(pa));
+
+	uio_kinit(&iov, &u, (void *)(PADDR_TO_KVADDR(pa) + pgoff), len,
+		  offset, UIO_READ);
+	result = VOP_READ(vn, &u);
+	if (result == 0 && u.uio_resid != 0) {
+		// executable shrank under us
+		result = EIO;
+	}
 
 	KASSERT(cm_pageispinned(pa));
 	cm_unpin(pa);
 	lock_release(lp -> lock);
 
+	if (result) {
+		lp_destroy(lp);
+		return (result);
+	}
+
 	*lpret = lp;
 	return (0);
 
 }
 
-// Destroys a Logical Page.
+// Writes a Page of a MAP_SHARED Mapping back to its File.
+// - len bytes from the start of the page go to offset
+// - every mapping is dropped first, so a write during or after the
+//   copy faults and sets mapdirty again
+int
+lp_writeback (struct lpage *lp, struct vnode *vn, off_t offset, size_t len)
+{
+
+	struct iovec iov;
+	struct uio u;
+	paddr_t pa;
+	int result;
+
+	DEBUG(DB_VM, "LPage: lp_writeback: offset = %llu, len = %u\n",
+	      (unsigned long long)offset, len);
+
+	KASSERT(len <= PAGE_SIZE);
+
+	lp_lock_and_pin(lp, &pa);
+
+	if (!lp -> mapdirty) {
+		if (pa != INVALID_PADDR) {
+			cm_unpin(pa);
+		}
+		lock_release(lp -> lock);
+		return (0);
+	}
+
+	if (pa == INVALID_PADDR) {
+		result = lp_pagein(lp, &pa);
+		if (result) {
+			lock_release(lp -> lock);
+			return (result);
+		}
+	}
+
+	KASSERT(cm_pageispinned(pa));
+
+	mmu_unmappage(pa);
+	lp -> mapdirty = 0;
+
+	uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(pa), len, offset,
+		  UIO_WRITE);
+	result = VOP_WRITE(vn, &u);
+	if (result) {
+		lp -> mapdirty = 1;
+	}
+
+	cm_unpin(pa);
+	lock_release(lp -> lock);
+
+	return (result);
+
+}
+
+// Brings Part of a Page of a Mapped File up to Date with the File.
+// - len bytes at pgoff within the page are read again from offset in
+//   vn, or zeroed if vn is NULL (the file was truncated)
+// - the file already has the change, so mapdirty is left alone; the
+//   swap copy doesn't, so the page is dirty now
+int
+lp_update (struct lpage *lp, size_t pgoff, size_t len, struct vnode *vn,
+	   off_t offset)
+{
+
+	struct iovec iov;
+	struct uio u;
+	paddr_t pa;
+	int result;
+
+	DEBUG(DB_VM, "LPage: lp_update: pgoff = %u, len = %u\n", pgoff, len);
+
+	KASSERT(pgoff + len <= PAGE_SIZE);
+
+	lp_lock_and_pin(lp, &pa);
+
+	if (pa == INVALID_PADDR) {
+		result = lp_pagein(lp, &pa);
+		if (result) {
+			lock_release(lp -> lock);
+			return (result);
+		}
+	}
+
+	KASSERT(cm_pageispinned(pa));
+
+	result = 0;
+	if (vn == NULL) {
+		bzero((char *)PADDR_TO_KVADDR(pa) + pgoff, len);
+	}
+	else {
+		uio_kinit(&iov, &u, (void *)(PADDR_TO_KVADDR(pa) + pgoff),
+			  len, offset, UIO_READ);
+		result = VOP_READ(vn, &u);
+		if (result == 0 && u.uio_resid != 0) {
+			// past the end now, as vmo_filetruncate leaves it
+			bzero((char *)PADDR_TO_KVADDR(pa) + pgoff +
+			      (len - u.uio_resid), u.uio_resid);
+		}
+	}
+	lp -> paddr |= LPF_DIRTY;
+
+	cm_unpin(pa);
+	lock_release(lp -> lock);
+
+	return (result);
+
+}
+
+// Drops a Reference to a Logical Page, Destroying it on the Last.
 void 					
 lp_destroy (struct lpage *lp)
 {
@@ -215,24 +759,21 @@ lp_destroy (struct lpage *lp)
 	KASSERT(lp != NULL);
 
 	lock_acquire(lp -> lock);
-	spl = splhigh();
-
-	pa = lp -> paddr & PAGE_FRAME;
-	if (pa != INVALID_PADDR) {
 
+	KASSERT(lp -> refcount > 0);
+	lp -> refcount--;
+	if (lp -> refcount > 0) {
 		lock_release(lp -> lock);
-		cm_pin(pa);
-		lock_acquire(lp -> lock);
+		return;
+	}
 
-		if ((lp -> paddr & PAGE_FRAME) == pa) {
-			cm_deallocpage(pa, 0);
-		}
-		else {
-			KASSERT((lp -> paddr & PAGE_FRAME) == INVALID_PADDR);
-		}
+	spl = splhigh();
 
+	// the frame may be relocated while we wait for the pin
+	lp_pin(lp, &pa);
+	if (pa != INVALID_PADDR) {
+		cm_deallocpage(pa, 0);
 		cm_unpin(pa);
-
 	}
 
 	splx(spl);
@@ -241,6 +782,7 @@ lp_destroy (struct lpage *lp)
 	if (lp -> swapaddr != INVALID_SWAPADDR) {
 		swap_deallocate(lp -> swapaddr);
 	}
+	swap_unreserve();
 
 	kfree(lp);
 
@@ -7,6 +7,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
 #include <kern/unistd.h>
 #include <kern/stat.h>
 #include <lib.h>
@@ -21,53 +22,357 @@
 #include <spl.h>
 #include <vm.h>
 #include <addrspace.h>
+#include <vmstat.h>
 
 struct lock *paging_lock;
 
+// raw disk used as the backing store
+#define SWAP_DEVICE		"lhd0raw:"
+
+// swap slot numbers <-> swap addresses
+#define SWAP_TO_SLOT(swa)	((unsigned)((swa) / PAGE_SIZE))
+#define SLOT_TO_SWAP(slot)	(((off_t)(slot)) * PAGE_SIZE)
+
+static struct vnode *swapstore;
+static struct bitmap *swapmap;		/* one bit per page-sized slot */
+static struct lock *swaplock;		/* protects swapmap & counters */
+static unsigned swap_total;		/* slots on the device */
+static unsigned swap_free;		/* slots not yet handed out */
+
+// swap reservation
+// - every logical page reserves swap when it is created, but only gets
+//   a slot the first time it is written out
+// - strictly, reservations never exceed the slots, so a page can always
+//   be evicted; with overcommit they may, and eviction can fail
+static struct spinlock swap_reslock;
+static unsigned swap_reserved;		/* pages that may need a slot */
+static int swap_overcommit;		/* reservations may exceed slots */
+
+// Opens the Swap Device and Sizes the Slot Bitmap.
 void
 swap_bootstrap (size_t pmemsize)
 {
 
-	(void)pmemsize;
+	char path[sizeof(SWAP_DEVICE)];
+	struct stat st;
+	int result;
+
+	DEBUG(DB_VM, "Swap: swap_bootstrap: pmemsize = %u\n", pmemsize);
+
+	// vfs_open mangles its argument
+	strcpy(path, SWAP_DEVICE);
+
+	result = vfs_open(path, O_RDWR, 0, &swapstore);
+	if (result) {
+		kprintf("swap: Error %d opening swap device %s\n",
+			result, SWAP_DEVICE);
+		panic("swap: Unable to continue.\n");
+	}
+
+	result = VOP_STAT(swapstore, &st);
+	if (result) {
+		panic("swap: Error %d getting size of %s\n",
+		      result, SWAP_DEVICE);
+	}
+
+	swap_total = st.st_size / PAGE_SIZE;
+	if (swap_total < 2) {
+		panic("swap: %s is too small to hold any pages\n",
+		      SWAP_DEVICE);
+	}
+
+	// unless overcommitting, user pages can't outnumber swap slots
+	if ((off_t)swap_total * PAGE_SIZE < (off_t)pmemsize) {
+		kprintf("swap: Warning: %s (%lu KB) is smaller than "
+			"physical memory (%lu KB)\n", SWAP_DEVICE,
+			(unsigned long)(swap_total * (PAGE_SIZE / 1024)),
+			(unsigned long)(pmemsize / 1024));
+	}
+
+	swapmap = bitmap_create(swap_total);
+	if (swapmap == NULL) {
+		panic("swap: No memory for swap bitmap\n");
+	}
+
+	swaplock = lock_create("swaplock");
+	if (swaplock == NULL) {
+		panic("swap: No memory for swap lock\n");
+	}
+
+	// slot 0 is INVALID_SWAPADDR; never hand it out
+	bitmap_mark(swapmap, SWAP_TO_SLOT(INVALID_SWAPADDR));
+	swap_free = swap_total - 1;
+
+	spinlock_init(&swap_reslock);
+	swap_reserved = 0;
+	swap_overcommit = 0;
+
+	kprintf("swap: %u pages (%lu KB) on %s\n", swap_free,
+		(unsigned long)(swap_free * (PAGE_SIZE / 1024)), SWAP_DEVICE);
 
 }
 
+// Closes the Swap Device.
 void
 swap_shutdown (void)
 {
-	
+
+	DEBUG(DB_VM, "Swap: swap_shutdown\n");
+
+	if (swapstore == NULL) {
+		return;
+	}
+
+	vfs_close(swapstore);
+	swapstore = NULL;
+
+	lock_destroy(swaplock);
+	bitmap_destroy(swapmap);
+	swaplock = NULL;
+	swapmap = NULL;
+
 }
 
+// Allocates a Swap Slot.
+// - returns INVALID_SWAPADDR if swap is full
 off_t
 swap_allocate (void)
 {
 
+	unsigned slot;
+	int result;
+
+	DEBUG(DB_VM, "Swap: swap_allocate\n");
+
+	KASSERT(swapmap != NULL);
+
+	lock_acquire(swaplock);
+
+	result = bitmap_alloc(swapmap, &slot);
+	if (result) {
+		KASSERT(swap_free == 0);
+		lock_release(swaplock);
+		return (INVALID_SWAPADDR);
+	}
+
+	KASSERT(swap_free > 0);
+	swap_free--;
+
+	lock_release(swaplock);
+
+	KASSERT(slot > 0 && slot < swap_total);
+	return (SLOT_TO_SWAP(slot));
+
+}
+
+// Reserves Swap for a New Logical Page.
+// - returns ENOSPC if that would promise more than the device holds,
+//   unless overcommitting
+int
+swap_reserve (void)
+{
+
+	DEBUG(DB_VM, "Swap: swap_reserve\n");
+
+	spinlock_acquire(&swap_reslock);
+	if (!swap_overcommit && swap_reserved >= swap_total - 1) {
+		spinlock_release(&swap_reslock);
+		return (ENOSPC);
+	}
+	swap_reserved++;
+	spinlock_release(&swap_reslock);
+
 	return (0);
 
 }
 
+// Gives Back a Logical Page's Reservation.
+void
+swap_unreserve (void)
+{
+
+	DEBUG(DB_VM, "Swap: swap_unreserve\n");
+
+	spinlock_acquire(&swap_reslock);
+	KASSERT(swap_reserved > 0);
+	swap_reserved--;
+	spinlock_release(&swap_reslock);
+
+}
+
+// Turns Swap Overcommit On or Off.
+// - turning it off doesn't take back reservations already made; new
+//   ones fail until enough pages are gone
+void
+swap_setovercommit (int on)
+{
+
+	spinlock_acquire(&swap_reslock);
+	swap_overcommit = on;
+	spinlock_release(&swap_reslock);
+
+}
+
+// Prints Swap Usage.
+void
+swap_printstats (void)
+{
+
+	unsigned reserved; unsigned used;
+	int overcommit;
+
+	spinlock_acquire(&swap_reslock);
+	reserved = swap_reserved;
+	overcommit = swap_overcommit;
+	spinlock_release(&swap_reslock);
+
+	lock_acquire(swaplock);
+	used = swap_total - 1 - swap_free;
+	lock_release(swaplock);
+
+	kprintf("Swap: %u of %u slots in use, %u pages reserved (%s)\n",
+		used, swap_total - 1, reserved,
+		overcommit ? "overcommit" : "strict");
+
+}
+
+// Releases a Swap Slot.
 void
 swap_deallocate (off_t swapaddr)
 {
 
-	(void)swapaddr;
+	unsigned slot;
+
+	DEBUG(DB_VM, "Swap: swap_deallocate\n");
+
+	KASSERT(swapaddr != INVALID_SWAPADDR);
+	KASSERT((swapaddr % PAGE_SIZE) == 0);
+
+	slot = SWAP_TO_SLOT(swapaddr);
+	KASSERT(slot < swap_total);
+
+	lock_acquire(swaplock);
+	KASSERT(bitmap_isset(swapmap, slot));
+	bitmap_unmark(swapmap, slot);
+	swap_free++;
+	lock_release(swaplock);
+
+}
+
+// Transfers npages Physically Contiguous Pages to/from Swap.
+// - the whole run goes to the device as one sector-aligned uio,
+//   so callers never hold paging_lock across per-sector requests
+static void
+swap_io (paddr_t pa, off_t swapaddr, unsigned npages, enum uio_rw rw)
+{
+
+	struct iovec iov;
+	struct uio u;
+	vaddr_t va;
+	int result;
+
+	KASSERT(swapstore != NULL);
+	KASSERT(npages > 0);
+	KASSERT((pa & PAGE_FRAME) == pa);
+	KASSERT(swapaddr != INVALID_SWAPADDR);
+	KASSERT((swapaddr % PAGE_SIZE) == 0);
+	KASSERT(SWAP_TO_SLOT(swapaddr) + npages <= swap_total);
+	KASSERT(!(curthread -> t_in_interrupt));
+
+	va = PADDR_TO_KVADDR(pa);
+	uio_kinit(&iov, &u, (void *)va, npages * PAGE_SIZE, swapaddr, rw);
+
+	if (rw == UIO_READ) {
+		result = VOP_READ(swapstore, &u);
+	}
+	else {
+		result = VOP_WRITE(swapstore, &u);
+	}
+
+	if (result) {
+		panic("swap: %s error %d at swap offset %llu\n",
+		      rw == UIO_READ ? "read" : "write", result,
+		      (unsigned long long)swapaddr);
+	}
+	if (u.uio_resid != 0) {
+		panic("swap: short %s at swap offset %llu\n",
+		      rw == UIO_READ ? "read" : "write",
+		      (unsigned long long)swapaddr);
+	}
 
 }
 
+// Reads a Page in from Swap.
 void
 swap_pagein (paddr_t pa, off_t swapaddr)
 {
 
-	(void)pa;
-	(void)swapaddr;	
+	DEBUG(DB_VM, "Swap: swap_pagein\n");
+
+	KASSERT(cm_pageispinned(pa));
+	swap_io(pa, swapaddr, 1, UIO_READ);
+	vmstat_inc(VMS_PAGEINS);
 
 }
 
+// Reads a Run of Consecutive Swap Slots into Scattered Frames.
+// - one uio with an iovec per frame, so read-ahead costs a single
+//   device request however the frames are laid out in memory
+void
+swap_pageinv (const paddr_t *pas, off_t swapaddr, unsigned npages)
+{
+
+	struct iovec iov[SWAP_MAXRUN];
+	struct uio u;
+	unsigned i;
+	int result;
+
+	DEBUG(DB_VM, "Swap: swap_pageinv: npages = %u\n", npages);
+
+	KASSERT(swapstore != NULL);
+	KASSERT(npages > 0 && npages <= SWAP_MAXRUN);
+	KASSERT(swapaddr != INVALID_SWAPADDR);
+	KASSERT((swapaddr % PAGE_SIZE) == 0);
+	KASSERT(SWAP_TO_SLOT(swapaddr) + npages <= swap_total);
+	KASSERT(!(curthread -> t_in_interrupt));
+
+	for (i = 0; i < npages; i++) {
+		KASSERT(cm_pageispinned(pas[i]));
+		iov[i].iov_kbase = (void *)PADDR_TO_KVADDR(pas[i]);
+		iov[i].iov_len = PAGE_SIZE;
+	}
+
+	u.uio_iov = iov;
+	u.uio_iovcnt = npages;
+	u.uio_offset = swapaddr;
+	u.uio_resid = npages * PAGE_SIZE;
+	u.uio_segflg = UIO_SYSSPACE;
+	u.uio_rw = UIO_READ;
+	u.uio_space = NULL;
+
+	result = VOP_READ(swapstore, &u);
+	if (result) {
+		panic("swap: read error %d at swap offset %llu\n", result,
+		      (unsigned long long)swapaddr);
+	}
+	if (u.uio_resid != 0) {
+		panic("swap: short read at swap offset %llu\n",
+		      (unsigned long long)swapaddr);
+	}
+
+	vmstat_add(VMS_PAGEINS, npages);
+
+}
+
+// Writes a Page out to Swap.
 void
 swap_pageout (paddr_t pa, off_t swapaddr)
 {
-	
-	(void)pa;
-	(void)swapaddr;
+
+	DEBUG(DB_VM, "Swap: swap_pageout\n");
+
+	KASSERT(cm_pageispinned(pa));
+	swap_io(pa, swapaddr, 1, UIO_WRITE);
+	vmstat_inc(VMS_PAGEOUTS);
 
 }
@@ -10,10 +10,297 @@
 #include <lib.h>
 #include <array.h>
 #include <spl.h>
+#include <stat.h>
+#include <synch.h>
+#include <vnode.h>
 #include <machine/coremap.h>
 #include <addrspace.h>
 #include <vm.h>
 
+// Clean Pages of a Read-Only Segment, Shared by every Process running
+// the same Executable.
+// - holds one reference on each page it has; each process's vm_object
+//   holds another, and a write would copy it like any shared page
+struct vmo_text {
+	struct vnode *vn;
+	off_t offset;
+	vaddr_t vaddr;
+	size_t filesize;
+	struct array *lpages;
+	unsigned refcount;	// vm_objects attached
+};
+
+static struct array *vmo_texts;
+static struct lock *vmo_textlock;
+
+// Pages of a Mapped File, Shared by every mmap of it.
+// - indexed by page of the file; holds one reference on each page so
+//   MAP_SHARED mappings see each other's writes and MAP_PRIVATE ones
+//   start out on the same frames and copy on write
+struct vmo_file {
+	struct vnode *vn;
+	struct array *lpages;
+	unsigned refcount;	// vm_objects attached
+};
+
+static struct array *vmo_files;
+static struct lock *vmo_filelock;
+
+// Placeholder for a Shared Page being Read In.
+// - vmo_fill puts it in the table and drops the table lock for the
+//   read; anyone else after the page waits on the table's cv
+#define VMO_FILLING		((struct lpage *)1)
+
+static struct cv *vmo_textcv;
+static struct cv *vmo_filecv;
+
+// One Zero-Filled Frame that Read Faults on Untouched Pages Map.
+// - mapped read-only, so the first write faults and gets a real page;
+//   a page only read never costs a frame or a swap slot
+static paddr_t vmo_zeropa;
+static uint32_t vmo_stat_zeromaps;	/* read faults it satisfied */
+
+// Sets up the Shared Text & Mapped File Tables.
+void
+vmo_bootstrap (void)
+{
+
+	vaddr_t va;
+
+	vmo_texts = array_create();
+	vmo_textlock = lock_create("vmo_text");
+	vmo_textcv = cv_create("vmo_text");
+	if (vmo_texts == NULL || vmo_textlock == NULL || vmo_textcv == NULL) {
+		panic("vmo_bootstrap: Out of memory\n");
+	}
+
+	vmo_files = array_create();
+	vmo_filelock = lock_create("vmo_file");
+	vmo_filecv = cv_create("vmo_file");
+	if (vmo_files == NULL || vmo_filelock == NULL || vmo_filecv == NULL) {
+		panic("vmo_bootstrap: Out of memory\n");
+	}
+
+	va = alloc_kpages(1);
+	if (va == 0) {
+		panic("vmo_bootstrap: Out of memory\n");
+	}
+	bzero((void *)va, PAGE_SIZE);
+	vmo_zeropa = KVADDR_TO_PADDR(va);
+	vmo_stat_zeromaps = 0;
+
+}
+
+// Finds or Creates the Shared Pages for a Segment.
+static struct vmo_text *
+vmo_text_get (struct vnode *vn, off_t offset, vaddr_t vaddr,
+	      size_t filesize, unsigned npages)
+{
+
+	struct vmo_text *t = NULL;
+	unsigned i;
+	int result;
+
+	KASSERT(lock_do_i_hold(vmo_textlock));
+
+	for (i = 0; i < array_num(vmo_texts); i++) {
+		t = array_get(vmo_texts, i);
+		if (t -> vn == vn && t -> offset == offset &&
+		    t -> vaddr == vaddr && t -> filesize == filesize &&
+		    array_num(t -> lpages) == npages) {
+			t -> refcount++;
+			return (t);
+		}
+	}
+
+	t = (struct vmo_text *)kmalloc(sizeof(struct vmo_text));
+	if (t == NULL) {
+		return (NULL);
+	}
+	t -> lpages = array_create();
+	if (t -> lpages == NULL) {
+		kfree(t);
+		return (NULL);
+	}
+	result = array_setsize(t -> lpages, npages);
+	if (result) {
+		array_destroy(t -> lpages);
+		kfree(t);
+		return (NULL);
+	}
+	for (i = 0; i < npages; i++) {
+		array_set(t -> lpages, i, NULL);
+	}
+
+	result = array_add(vmo_texts, t, NULL);
+	if (result) {
+		array_setsize(t -> lpages, 0);
+		array_destroy(t -> lpages);
+		kfree(t);
+		return (NULL);
+	}
+
+	VOP_INCREF(vn);
+	t -> vn = vn;
+	t -> offset = offset;
+	t -> vaddr = vaddr;
+	t -> filesize = filesize;
+	t -> refcount = 1;
+
+	return (t);
+
+}
+
+// Drops a vm_object's Hold on Shared Pages.
+// - the last one out frees the pages
+static void
+vmo_text_put (struct vmo_text *t)
+{
+
+	struct lpage *lp = NULL;
+	unsigned i;
+
+	lock_acquire(vmo_textlock);
+
+	KASSERT(t -> refcount > 0);
+	t -> refcount--;
+	if (t -> refcount > 0) {
+		lock_release(vmo_textlock);
+		return;
+	}
+
+	for (i = 0; i < array_num(vmo_texts); i++) {
+		if (array_get(vmo_texts, i) == t) {
+			array_remove(vmo_texts, i);
+			break;
+		}
+	}
+
+	lock_release(vmo_textlock);
+
+	for (i = 0; i < array_num(t -> lpages); i++) {
+		lp = array_get(t -> lpages, i);
+		if (lp != NULL) {
+			lp_destroy(lp);
+		}
+	}
+	array_setsize(t -> lpages, 0);
+	array_destroy(t -> lpages);
+	VOP_DECREF(t -> vn);
+	kfree(t);
+
+}
+
+// Finds or Creates the Shared Pages of a Mapped File.
+// - the table grows to cover at least npages pages of the file
+static struct vmo_file *
+vmo_file_get (struct vnode *vn, unsigned npages)
+{
+
+	struct vmo_file *f = NULL;
+	unsigned i; unsigned oldsize;
+	int result;
+
+	KASSERT(lock_do_i_hold(vmo_filelock));
+
+	for (i = 0; i < array_num(vmo_files); i++) {
+		f = array_get(vmo_files, i);
+		if (f -> vn == vn) {
+			break;
+		}
+		f = NULL;
+	}
+
+	if (f != NULL) {
+		oldsize = array_num(f -> lpages);
+		if (npages > oldsize) {
+			result = array_setsize(f -> lpages, npages);
+			if (result) {
+				return (NULL);
+			}
+			for (i = oldsize; i < npages; i++) {
+				array_set(f -> lpages, i, NULL);
+			}
+		}
+		f -> refcount++;
+		return (f);
+	}
+
+	f = (struct vmo_file *)kmalloc(sizeof(struct vmo_file));
+	if (f == NULL) {
+		return (NULL);
+	}
+	f -> lpages = array_create();
+	if (f -> lpages == NULL) {
+		kfree(f);
+		return (NULL);
+	}
+	result = array_setsize(f -> lpages, npages);
+	if (result) {
+		array_destroy(f -> lpages);
+		kfree(f);
+		return (NULL);
+	}
+	for (i = 0; i < npages; i++) {
+		array_set(f -> lpages, i, NULL);
+	}
+
+	result = array_add(vmo_files, f, NULL);
+	if (result) {
+		array_setsize(f -> lpages, 0);
+		array_destroy(f -> lpages);
+		kfree(f);
+		return (NULL);
+	}
+
+	VOP_INCREF(vn);
+	f -> vn = vn;
+	f -> refcount = 1;
+
+	return (f);
+
+}
+
+// Drops a vm_object's Hold on a Mapped File.
+// - the last one out frees the pages
+static void
+vmo_file_put (struct vmo_file *f)
+{
+
+	struct lpage *lp = NULL;
+	unsigned i;
+
+	lock_acquire(vmo_filelock);
+
+	KASSERT(f -> refcount > 0);
+	f -> refcount--;
+	if (f -> refcount > 0) {
+		lock_release(vmo_filelock);
+		return;
+	}
+
+	for (i = 0; i < array_num(vmo_files); i++) {
+		if (array_get(vmo_files, i) == f) {
+			array_remove(vmo_files, i);
+			break;
+		}
+	}
+
+	lock_release(vmo_filelock);
+
+	for (i = 0; i < array_num(f -> lpages); i++) {
+		lp = array_get(f -> lpages, i);
+		if (lp != NULL) {
+			lp_destroy(lp);
+		}
+	}
+	array_setsize(f -> lpages, 0);
+	array_destroy(f -> lpages);
+	VOP_DECREF(f -> vn);
+	kfree(f);
+
+}
+
 // Creates a VM_Object.
 struct vm_object *
 vmo_create (size_t npages)
@@ -38,6 +325,17 @@ vmo_create (size_t npages)
 	// filled in as_define_region
 	vmo -> base = 0xdeadbeef;
 	vmo -> redzone = 0xdeafbeef;
+	vmo -> perms = VMO_R | VMO_W;
+
+	// anonymous until vmo_setfile
+	vmo -> vn = NULL;
+	vmo -> vnoffset = 0;
+	vmo -> vnvaddr = 0;
+	vmo -> vnsize = 0;
+	vmo -> text = NULL;
+	vmo -> file = NULL;
+	vmo -> shared = 0;
+	vmo -> zeromapped = 0;
 
 	// add zerofilled pages
 	result = array_setsize(vmo -> lpages, npages);
@@ -56,14 +354,17 @@ vmo_create (size_t npages)
 }
 
 // Copies *vmo into **ret.
+// - pages are shared copy-on-write rather than copied, and oldas
+//   loses write access to them until the next fault
 int
-vmo_copy (struct vm_object *vmo, struct addrspace *newas, struct vm_object **ret)
+vmo_copy (struct vm_object *vmo, struct addrspace *oldas,
+	  struct addrspace *newas, struct vm_object **ret)
 {
 
 	struct vm_object *newvmo = NULL;
 	struct lpage *newlp = NULL;
 	struct lpage *lp = NULL;
-	int j; int result;
+	int j;
 
 	DEBUG(DB_VM, "VMObject: vmo_copy\n");
 
@@ -74,6 +375,34 @@ vmo_copy (struct vm_object *vmo, struct addrspace *newas, struct vm_object **ret
 
 	newvmo -> base = vmo -> base;
 	newvmo -> redzone = vmo -> redzone;
+	newvmo -> perms = vmo -> perms;
+
+	// untouched pages still come from the executable
+	if (vmo -> vn != NULL) {
+		VOP_INCREF(vmo -> vn);
+		newvmo -> vn = vmo -> vn;
+		newvmo -> vnoffset = vmo -> vnoffset;
+		newvmo -> vnvaddr = vmo -> vnvaddr;
+		newvmo -> vnsize = vmo -> vnsize;
+	}
+	if (vmo -> text != NULL) {
+		lock_acquire(vmo_textlock);
+		KASSERT(vmo -> text -> refcount > 0);
+		vmo -> text -> refcount++;
+		lock_release(vmo_textlock);
+		newvmo -> text = vmo -> text;
+	}
+	if (vmo -> file != NULL) {
+		lock_acquire(vmo_filelock);
+		KASSERT(vmo -> file -> refcount > 0);
+		vmo -> file -> refcount++;
+		lock_release(vmo_filelock);
+		newvmo -> file = vmo -> file;
+	}
+	newvmo -> shared = vmo -> shared;
+
+	// other cpus take all the protections in one interrupt
+	mmu_batchbegin(oldas);
 
 	for (j = 0; (unsigned)j < array_num(vmo -> lpages); j++) {
 
@@ -83,16 +412,15 @@ vmo_copy (struct vm_object *vmo, struct addrspace *newas, struct vm_object **ret
 		KASSERT(newlp == NULL);
 
 		if (lp != NULL) {
-			result = lp_copy(lp, &newlp);
-			if (result) {
-				vmo_destroy(newas, newvmo);
-				return (result);
-			}
-			array_set(newvmo -> lpages, j, newlp);
+			lp_share(lp);
+			array_set(newvmo -> lpages, j, lp);
+			mmu_protect(oldas, vmo -> base + PAGE_SIZE*j);
 		}
 
 	}
 
+	mmu_batchend(oldas);
+
 	*ret = newvmo;
 	return (0);
 
@@ -114,6 +442,9 @@ vmo_resize (struct addrspace *as, struct vm_object *vmo, int npages)
 	if ((unsigned)npages < array_num(vmo -> lpages)) {
 
 		spl = splhigh();
+		if (as != NULL) {
+			mmu_batchbegin(as);
+		}
 
 		for (i = npages; (unsigned)i < array_num(vmo -> lpages); i++) {
 			lp = array_get(vmo -> lpages, i);
@@ -122,8 +453,15 @@ vmo_resize (struct addrspace *as, struct vm_object *vmo, int npages)
 				mmu_unmap(as, vmo -> base + PAGE_SIZE*i);
 				lp_destroy(lp);
 			}
+			else if (vmo -> zeromapped && as != NULL) {
+				// may be mapped to the zero frame
+				mmu_unmap(as, vmo -> base + PAGE_SIZE*i);
+			}
 		}
 
+		if (as != NULL) {
+			mmu_batchend(as);
+		}
 		splx(spl);
 		result = array_setsize(vmo -> lpages, npages);
 
@@ -155,10 +493,469 @@ vmo_destroy (struct addrspace *as, struct vm_object *vmo)
 
 	DEBUG(DB_VM, "VMObject: vmo_destroy\n");
 
+	// nowhere to report a failure to; msync first if it matters
+	if (vmo -> shared) {
+		(void)vmo_sync(vmo, 0, array_num(vmo -> lpages));
+	}
+
 	result = vmo_resize(as, vmo, 0);
 	KASSERT(result == 0);
+
+	if (vmo -> text != NULL) {
+		vmo_text_put(vmo -> text);
+	}
+	if (vmo -> file != NULL) {
+		vmo_file_put(vmo -> file);
+	}
+	if (vmo -> vn != NULL) {
+		VOP_DECREF(vmo -> vn);
+	}
 	
 	array_destroy(vmo -> lpages);
 	kfree(vmo);
 
 }
+
+// Backs a VM_Object with part of an Executable.
+// - filesize bytes at offset appear at vaddr; pages are read in on
+//   first touch by vmo_fill instead of at exec time
+// - if share is set the pages are clean text, and every process
+//   running this executable gets the same frames
+int
+vmo_setfile (struct vm_object *vmo, struct vnode *vn, off_t offset,
+	     vaddr_t vaddr, size_t filesize, int share)
+{
+
+	DEBUG(DB_VM, "VMObject: vmo_setfile: vaddr = %x, filesize = %u\n",
+	      vaddr, filesize);
+
+	KASSERT(vmo -> vn == NULL);
+	KASSERT(vaddr >= vmo -> base);
+	KASSERT(vaddr + filesize <=
+		vmo -> base + PAGE_SIZE * array_num(vmo -> lpages));
+
+	if (share) {
+		lock_acquire(vmo_textlock);
+		vmo -> text = vmo_text_get(vn, offset, vaddr, filesize,
+					   array_num(vmo -> lpages));
+		lock_release(vmo_textlock);
+		if (vmo -> text == NULL) {
+			return (ENOMEM);
+		}
+	}
+
+	VOP_INCREF(vn);
+	vmo -> vn = vn;
+	vmo -> vnoffset = offset;
+	vmo -> vnvaddr = vaddr;
+	vmo -> vnsize = filesize;
+
+	return (0);
+
+}
+
+// Backs a VM_Object with a Mapped File.
+// - offset is page aligned and appears at the base of the vm_object;
+//   bytes past the end of the file read as zero and aren't written back
+// - pages come from the file's shared table, so all mappings of the
+//   file start out on the same frames
+int
+vmo_setmap (struct vm_object *vmo, struct vnode *vn, off_t offset,
+	    off_t filesize, int shared)
+{
+
+	size_t vmosize;
+
+	DEBUG(DB_VM, "VMObject: vmo_setmap: offset = %llu, shared = %d\n",
+	      (unsigned long long)offset, shared);
+
+	KASSERT(vmo -> vn == NULL);
+	KASSERT(offset % PAGE_SIZE == 0);
+
+	vmosize = PAGE_SIZE * array_num(vmo -> lpages);
+
+	lock_acquire(vmo_filelock);
+	vmo -> file = vmo_file_get(vn, offset / PAGE_SIZE +
+				   array_num(vmo -> lpages));
+	lock_release(vmo_filelock);
+	if (vmo -> file == NULL) {
+		return (ENOMEM);
+	}
+
+	VOP_INCREF(vn);
+	vmo -> vn = vn;
+	vmo -> vnoffset = offset;
+	vmo -> vnvaddr = vmo -> base;
+	vmo -> vnsize = 0;
+	if (filesize > offset) {
+		vmo -> vnsize = filesize - offset < (off_t)vmosize ?
+				(size_t)(filesize - offset) : vmosize;
+	}
+	vmo -> shared = shared;
+
+	return (0);
+
+}
+
+// Gets how much of a Mapped File's VM_Object the File Covers Now.
+// - the file may have grown or shrunk since it was mapped
+static int
+vmo_mapsize (struct vm_object *vmo, size_t *ret)
+{
+
+	struct stat st;
+	size_t vmosize;
+	int result;
+
+	KASSERT(vmo -> file != NULL);
+
+	result = VOP_STAT(vmo -> vn, &st);
+	if (result) {
+		return (result);
+	}
+
+	vmosize = PAGE_SIZE * array_num(vmo -> lpages);
+	*ret = 0;
+	if (st.st_size > vmo -> vnoffset) {
+		*ret = st.st_size - vmo -> vnoffset < (off_t)vmosize ?
+		       (size_t)(st.st_size - vmo -> vnoffset) : vmosize;
+	}
+
+	return (0);
+
+}
+
+// Writes Pages of a MAP_SHARED VM_Object back to its File.
+// - only pages written since they were last synced are written
+// - nothing past the file's current end goes back, so a mapping
+//   never grows a file again after ftruncate shrank it
+int
+vmo_sync (struct vm_object *vmo, unsigned first, unsigned npages)
+{
+
+	struct lpage *lp = NULL;
+	size_t pageoff; size_t len; size_t vnsize;
+	unsigned i;
+	int result; int err;
+
+	DEBUG(DB_VM, "VMObject: vmo_sync: first = %u, npages = %u\n",
+	      first, npages);
+
+	KASSERT(vmo -> shared && vmo -> vn != NULL);
+	KASSERT(first + npages <= array_num(vmo -> lpages));
+
+	result = vmo_mapsize(vmo, &vnsize);
+	if (result) {
+		return (result);
+	}
+
+	err = 0;
+	for (i = first; i < first + npages; i++) {
+
+		lp = array_get(vmo -> lpages, i);
+		pageoff = PAGE_SIZE * i;
+		if (lp == NULL || pageoff >= vnsize) {
+			continue;
+		}
+
+		len = vnsize - pageoff;
+		if (len > PAGE_SIZE) {
+			len = PAGE_SIZE;
+		}
+
+		result = lp_writeback(lp, vmo -> vn, vmo -> vnoffset + pageoff,
+				      len);
+		if (result && err == 0) {
+			err = result;
+		}
+
+	}
+
+	return (err);
+
+}
+
+// Brings the Mapped Pages of a File up to Date.
+// - len bytes at offset in the file changed (len < 0 means to the end
+//   of the table); pages of the file's table that are in read them
+//   again, or zero them if truncate is set, so mappings see the change
+//   and a later msync doesn't write back what was there before
+// - a page being read in is waited for, since it may hold older data
+// - the table lock is only held to look a page up; the page itself
+//   is updated under its own lock
+static int
+vmo_fileupdate (struct vnode *vn, off_t offset, off_t len, int truncate)
+{
+
+	struct vmo_file *f = NULL;
+	struct lpage *lp = NULL;
+	size_t pgoff; size_t n;
+	unsigned i;
+	int result;
+
+	// nothing is mapped, the usual case; a mapping made after this
+	// reads the file after the change anyway
+	if (array_num(vmo_files) == 0) {
+		return (0);
+	}
+
+	lock_acquire(vmo_filelock);
+	for (i = 0; i < array_num(vmo_files); i++) {
+		f = array_get(vmo_files, i);
+		if (f -> vn == vn) {
+			break;
+		}
+		f = NULL;
+	}
+	if (f == NULL) {
+		lock_release(vmo_filelock);
+		return (0);
+	}
+	// keep the table while we work without the lock
+	f -> refcount++;
+
+	result = 0;
+	while (len != 0 && result == 0 &&
+	       offset / PAGE_SIZE < array_num(f -> lpages)) {
+
+		i = offset / PAGE_SIZE;
+		pgoff = offset % PAGE_SIZE;
+		n = PAGE_SIZE - pgoff;
+		if (len > 0 && (off_t)n > len) {
+			n = len;
+		}
+
+		while ((lp = array_get(f -> lpages, i)) == VMO_FILLING) {
+			cv_wait(vmo_filecv, vmo_filelock);
+		}
+		if (lp != NULL) {
+			lp_share(lp);
+			lock_release(vmo_filelock);
+			result = lp_update(lp, pgoff, n, truncate ? NULL : vn,
+					   offset);
+			lp_destroy(lp);
+			lock_acquire(vmo_filelock);
+		}
+
+		offset += n;
+		if (len > 0) {
+			len -= n;
+		}
+
+	}
+
+	lock_release(vmo_filelock);
+	vmo_file_put(f);
+
+	return (result);
+
+}
+
+// Updates the Mapped Pages of a File after a write().
+// - the file system calls this once len bytes at offset are in the
+//   file, without holding any of its own locks; page faults hold a
+//   page's lock while they read the file
+int
+vmo_filewrite (struct vnode *vn, off_t offset, size_t len)
+{
+
+	DEBUG(DB_VM, "VMObject: vmo_filewrite: offset = %llu, len = %u\n",
+	      (unsigned long long)offset, len);
+
+	return (vmo_fileupdate(vn, offset, len, 0));
+
+}
+
+// Zeroes what the Mapped Pages of a File hold Past its End.
+// - called like vmo_filewrite, once the file has been truncated to len
+int
+vmo_filetruncate (struct vnode *vn, off_t len)
+{
+
+	DEBUG(DB_VM, "VMObject: vmo_filetruncate: len = %llu\n",
+	      (unsigned long long)len);
+
+	return (vmo_fileupdate(vn, len, -1, 1));
+
+}
+
+// Finds the Part of a Page that comes from the File.
+// - vnsize bytes of the file appear at vnvaddr
+// - [*lo, *hi) is empty if none of it does
+static void
+vmo_filebytes (struct vm_object *vmo, size_t vnsize, vaddr_t pageva,
+	       vaddr_t *lo, vaddr_t *hi)
+{
+
+	*lo = pageva > vmo -> vnvaddr ? pageva : vmo -> vnvaddr;
+	*hi = vmo -> vnvaddr + vnsize;
+	if (*hi > pageva + PAGE_SIZE) {
+		*hi = pageva + PAGE_SIZE;
+	}
+
+}
+
+// Maps an Untouched Page to the Zero Frame for a Read Fault.
+// - only for pages vmo_fill would zero-fill privately; text and mapped
+//   file pages come from their shared tables instead
+// - returns ENOENT if the page must be filled for real
+int
+vmo_mapzero (struct addrspace *as, struct vm_object *vmo, unsigned index)
+{
+
+	vaddr_t pageva; vaddr_t lo; vaddr_t hi;
+	int spl;
+
+	DEBUG(DB_VM, "VMObject: vmo_mapzero: index = %u\n", index);
+
+	KASSERT(index < array_num(vmo -> lpages));
+	KASSERT(array_get(vmo -> lpages, index) == NULL);
+
+	pageva = vmo -> base + PAGE_SIZE * index;
+
+	if (vmo -> vn != NULL) {
+		if (vmo -> text != NULL || vmo -> file != NULL) {
+			return (ENOENT);
+		}
+		vmo_filebytes(vmo, vmo -> vnsize, pageva, &lo, &hi);
+		if (lo < hi) {
+			return (ENOENT);
+		}
+	}
+
+	vmo -> zeromapped = 1;
+	mmu_map(as, pageva, vmo_zeropa, 0);
+
+	spl = splhigh();
+	vmo_stat_zeromaps++;
+	splx(spl);
+
+	return (0);
+
+}
+
+// Prints Zero Frame Statistics.
+void
+vmo_printzerostats (void)
+{
+
+	uint32_t maps;
+	int spl;
+
+	spl = splhigh();
+	maps = vmo_stat_zeromaps;
+	splx(spl);
+
+	kprintf("Zero frame: %lu read faults mapped it\n",
+		(unsigned long)maps);
+
+}
+
+// Creates the Logical Page for an Untouched Page of a VM_Object.
+// - pages of an executable or mapped file are read from it, the rest
+//   are zero-filled
+// - the caller unmaps the zero frame first if vmo_mapzero used it
+// - text and mapped file pages are looked up in their shared table
+//   first, and kept there for the next user
+// - the table lock isn't held while the page is read, so faults on
+//   other pages aren't kept waiting behind the disk
+int
+vmo_fill (struct vm_object *vmo, unsigned index, struct lpage **ret)
+{
+
+	struct lpage *lp = NULL;
+	struct array *cache = NULL;
+	struct lock *cachelock = NULL;
+	struct cv *cachecv = NULL;
+	vaddr_t pageva; vaddr_t lo; vaddr_t hi;
+	size_t vnsize;
+	unsigned cacheix;
+	int result;
+
+	DEBUG(DB_VM, "VMObject: vmo_fill: index = %u\n", index);
+
+	KASSERT(index < array_num(vmo -> lpages));
+	KASSERT(array_get(vmo -> lpages, index) == NULL);
+
+	if (vmo -> vn == NULL) {
+		return (lp_zero(ret));
+	}
+
+	cacheix = 0;
+	if (vmo -> text != NULL) {
+		cache = vmo -> text -> lpages;
+		cachelock = vmo_textlock;
+		cachecv = vmo_textcv;
+		cacheix = index;
+	}
+	else if (vmo -> file != NULL) {
+		cache = vmo -> file -> lpages;
+		cachelock = vmo_filelock;
+		cachecv = vmo_filecv;
+		cacheix = vmo -> vnoffset / PAGE_SIZE + index;
+	}
+
+	if (cache != NULL) {
+
+		// another run or mapping may have read it already, or be
+		// reading it now
+		lock_acquire(cachelock);
+		while ((lp = array_get(cache, cacheix)) == VMO_FILLING) {
+			cv_wait(cachecv, cachelock);
+		}
+		if (lp != NULL) {
+			lp_share(lp);
+			lock_release(cachelock);
+			*ret = lp;
+			return (0);
+		}
+		array_set(cache, cacheix, VMO_FILLING);
+		lock_release(cachelock);
+
+	}
+
+	// a mapped file may have changed size since it was mapped; look
+	// once the placeholder is in, so a write() or ftruncate() from
+	// here on waits for the page and then brings it up to date
+	vnsize = vmo -> vnsize;
+	result = 0;
+	if (vmo -> file != NULL) {
+		result = vmo_mapsize(vmo, &vnsize);
+	}
+
+	if (result == 0) {
+		pageva = vmo -> base + PAGE_SIZE * index;
+		vmo_filebytes(vmo, vnsize, pageva, &lo, &hi);
+		if (lo >= hi) {
+			result = lp_zero(&lp);
+		}
+		else {
+			result = lp_fill(&lp, vmo -> vn,
+					 vmo -> vnoffset + (lo - vmo -> vnvaddr),
+					 lo - pageva, hi - lo);
+		}
+	}
+
+	if (cache != NULL) {
+		lock_acquire(cachelock);
+		KASSERT(array_get(cache, cacheix) == VMO_FILLING);
+		if (result == 0) {
+			lp_share(lp);
+			array_set(cache, cacheix, lp);
+		}
+		else {
+			// the next faulter tries again
+			array_set(cache, cacheix, NULL);
+		}
+		cv_broadcast(cachecv, cachelock);
+		lock_release(cachelock);
+	}
+
+	if (result) {
+		return (result);
+	}
+
+	*ret = lp;
+	return (0);
+
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu VM event counters, and snapshots of them for the __vmstat()
+ * system call and the "vs" menu command.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <thread.h>
+#include <platform/maxcpus.h>
+#include <machine/coremap.h>
+#include <vmstat.h>
+
+// each cpu only bumps its own row, with interrupts off, so counting
+// needs no lock; readers may see a row mid-update, which is fine for
+// statistics
+static uint32_t vmstat_counts[MAXCPUS][VMS_NCOUNTERS];
+
+// Adds n to one of this CPU's Event Counters.
+void
+vmstat_add (unsigned which, uint32_t n)
+{
+
+	unsigned me;
+	int spl;
+
+	KASSERT(which < VMS_NCOUNTERS);
+
+	spl = splhigh();
+	me = CURCPU_EXISTS() ? curcpu -> c_number : 0;
+	KASSERT(me < MAXCPUS);
+	vmstat_counts[me][which] += n;
+	splx(spl);
+
+}
+
+// Takes a Snapshot of the VM Statistics.
+// - cpu picks whose events to report, or VMSTAT_ALLCPUS for the sum
+// - returns EINVAL for a cpu that doesn't exist
+int
+vmstat_get (int cpu, struct vmstat *vs)
+{
+
+	uint32_t counts[VMS_NCOUNTERS];
+	unsigned i; unsigned j;
+	unsigned kern; unsigned user; unsigned free;
+
+	if (cpu != VMSTAT_ALLCPUS &&
+	    (cpu < 0 || (unsigned)cpu >= thread_numcpus())) {
+		return (EINVAL);
+	}
+
+	for (j = 0; j < VMS_NCOUNTERS; j++) {
+		counts[j] = 0;
+	}
+	for (i = 0; i < MAXCPUS; i++) {
+		if (cpu != VMSTAT_ALLCPUS && (unsigned)cpu != i) {
+			continue;
+		}
+		for (j = 0; j < VMS_NCOUNTERS; j++) {
+			counts[j] += vmstat_counts[i][j];
+		}
+	}
+
+	vs -> vs_faults = counts[VMS_FAULTS];
+	vs -> vs_tlbmisses = counts[VMS_TLBMISSES];
+	vs -> vs_tlbevictions = counts[VMS_TLBEVICTIONS];
+	vs -> vs_zerofills = counts[VMS_ZEROFILLS];
+	vs -> vs_cowcopies = counts[VMS_COWCOPIES];
+	vs -> vs_pageins = counts[VMS_PAGEINS];
+	vs -> vs_pageouts = counts[VMS_PAGEOUTS];
+	vs -> vs_pinwaits = counts[VMS_PINWAITS];
+
+	cm_framecounts(&kern, &user, &free);
+	vs -> vs_frameskernel = kern;
+	vs -> vs_framesuser = user;
+	vs -> vs_framesfree = free;
+
+	return (0);
+
+}
+
+// Prints VM Statistics, per CPU and Summed.
+void
+vmstat_print (void)
+{
+
+	struct vmstat vs;
+	unsigned i;
+	int result;
+
+	kprintf("cpu      faults   tlbmiss  tlbevict     zero"
+		"      cow    pagein   pageout  pinwait\n");
+
+	for (i = 0; i < thread_numcpus(); i++) {
+		result = vmstat_get(i, &vs);
+		KASSERT(result == 0);
+		// cpus that never did anything are not worth a line
+		if (i > 0 && vs.vs_faults == 0 && vs.vs_tlbmisses == 0) {
+			continue;
+		}
+		kprintf("%3u %9lu %9lu %9lu %8lu %8lu %9lu %9lu %8lu\n", i,
+			(unsigned long)vs.vs_faults,
+			(unsigned long)vs.vs_tlbmisses,
+			(unsigned long)vs.vs_tlbevictions,
+			(unsigned long)vs.vs_zerofills,
+			(unsigned long)vs.vs_cowcopies,
+			(unsigned long)vs.vs_pageins,
+			(unsigned long)vs.vs_pageouts,
+			(unsigned long)vs.vs_pinwaits);
+	}
+
+	result = vmstat_get(VMSTAT_ALLCPUS, &vs);
+	KASSERT(result == 0);
+	kprintf("all %9lu %9lu %9lu %8lu %8lu %9lu %9lu %8lu\n",
+		(unsigned long)vs.vs_faults,
+		(unsigned long)vs.vs_tlbmisses,
+		(unsigned long)vs.vs_tlbevictions,
+		(unsigned long)vs.vs_zerofills,
+		(unsigned long)vs.vs_cowcopies,
+		(unsigned long)vs.vs_pageins,
+		(unsigned long)vs.vs_pageouts,
+		(unsigned long)vs.vs_pinwaits);
+
+	kprintf("frames: %lu free, %lu kernel, %lu user\n",
+		(unsigned long)vs.vs_framesfree,
+		(unsigned long)vs.vs_frameskernel,
+		(unsigned long)vs.vs_framesuser);
+
+}
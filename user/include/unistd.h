@@ -42,6 +42,7 @@
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/vmstat.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -56,6 +57,9 @@
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
  *     mkdir:    sys/stat.h
+ *     mmap:     sys/mman.h
+ *     munmap:   sys/mman.h
+ *     msync:    sys/mman.h
  *
  * If this were standard Unix, more prototypes would go in other
  * header files as well, as follows:
@@ -147,6 +151,9 @@ int chdir(const char *path);
 
 /* Optional. */
 void *sbrk(int change);
+/* mmap - see sys/mman.h */
+/* munmap - see sys/mman.h */
+/* msync - see sys/mman.h */
 int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
@@ -154,6 +161,7 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+int __vmstat(struct vmstat *vs, int cpu);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -68,6 +68,9 @@ dumpsb(void)
 	sp.sp_volname[sizeof(sp.sp_volname)-1] = 0;
 	printf("Volume name: %-40s  %u blocks\n", sp.sp_volname, 
 	       SWAPL(sp.sp_nblocks));
+	if (SWAPL(sp.sp_flags) & SFS_SPF_EXTENTS) {
+		printf("New files use extents\n");
+	}
 
 	return SWAPL(sp.sp_nblocks);
 }
@@ -95,12 +98,43 @@ dodirblock(uint32_t block)
 	}
 }
 
+/*
+ * Dump the directory blocks under an indirect block INDIRECTION
+ * levels above them.
+ */
+static
+void
+dodirindirect(uint32_t iblock, int indirection, uint32_t *nblocksp)
+{
+	uint32_t ib[SFS_DBPERIDB];
+	uint32_t block;
+	int i;
+
+	if (iblock == 0) {
+		return;
+	}
+
+	diskread(&ib, iblock);
+	for (i=0; i<SFS_DBPERIDB; i++) {
+		block = SWAPL(ib[i]);
+		if (block == 0) {
+			continue;
+		}
+		if (indirection > 1) {
+			dodirindirect(block, indirection-1, nblocksp);
+		}
+		else {
+			dodirblock(block);
+			(*nblocksp)++;
+		}
+	}
+}
+
 static
 void
 dumpdir(uint32_t ino)
 {
 	struct sfs_inode sfi;
-	uint32_t ib[SFS_DBPERIDB];
 	int nentries, i;
 	uint32_t block, nblocks=0;
 
@@ -112,6 +146,21 @@ dumpdir(uint32_t ino)
 	}
 	printf("Directory %u: %d entries\n", ino, nentries);
 
+	if (SWAPL(sfi.sfi_flags) & SFS_IF_EXTENTS) {
+		for (i=0; i<SFS_NEXTENTS; i++) {
+			uint32_t n = SWAPL(sfi.sfi_extents[i].sfe_nblocks);
+			uint32_t j;
+
+			block = SWAPL(sfi.sfi_extents[i].sfe_diskblock);
+			for (j=0; j<n; j++) {
+				dodirblock(block + j);
+				nblocks++;
+			}
+		}
+		printf("    %u blocks in directory\n", nblocks);
+		return;
+	}
+
 	for (i=0; i<SFS_NDIRECT; i++) {
 		block = SWAPL(sfi.sfi_direct[i]);
 		if (block) {
@@ -119,16 +168,9 @@ dumpdir(uint32_t ino)
 			nblocks++;
 		}
 	}
-	if (SWAPL(sfi.sfi_indirect)) {
-		diskread(&ib, SWAPL(sfi.sfi_indirect));
-		for (i=0; i<SFS_DBPERIDB; i++) {
-			block = SWAPL(ib[i]);
-			if (block) {
-				dodirblock(block);
-				nblocks++;
-			}
-		}
-	}
+	dodirindirect(SWAPL(sfi.sfi_indirect), 1, &nblocks);
+	dodirindirect(SWAPL(sfi.sfi_dindirect), 2, &nblocks);
+	dodirindirect(SWAPL(sfi.sfi_tindirect), 3, &nblocks);
 	printf("    %u blocks in directory\n", nblocks);
 }
 
@@ -68,7 +68,7 @@ check(void)
 
 static
 void
-writesuper(const char *volname, uint32_t nblocks)
+writesuper(const char *volname, uint32_t nblocks, uint32_t flags)
 {
 	struct sfs_super sp;
 
@@ -80,6 +80,7 @@ writesuper(const char *volname, uint32_t nblocks)
 
 	sp.sp_magic = SWAPL(SFS_MAGIC);
 	sp.sp_nblocks = SWAPL(nblocks);
+	sp.sp_flags = SWAPL(flags);
 	strcpy(sp.sp_volname, volname);
 
 	diskwrite(&sp, SFS_SB_LOCATION);
@@ -146,15 +147,22 @@ writebitmap(uint32_t fsblocks)
 int
 main(int argc, char **argv)
 {
-	uint32_t size, blocksize;
+	uint32_t size, blocksize, flags = 0;
 	char *volname, *s;
 
 #ifdef HOST
 	hostcompat_init(argc, argv);
 #endif
 
+	/* -e: map new files with extents */
+	if (argc==4 && !strcmp(argv[1], "-e")) {
+		flags |= SFS_SPF_EXTENTS;
+		argc--;
+		argv++;
+	}
+
 	if (argc!=3) {
-		errx(1, "Usage: mksfs device/diskfile volume-name");
+		errx(1, "Usage: mksfs [-e] device/diskfile volume-name");
 	}
 
 	check();
@@ -185,7 +193,7 @@ main(int argc, char **argv)
 	}
 	size = diskblocks();
 
-	writesuper(volname, size);
+	writesuper(volname, size, flags);
 	writerootdir();
 	writebitmap(size);
 
@@ -83,6 +83,7 @@ swapsb(struct sfs_super *sp)
 {
 	sp->sp_magic = SWAPL(sp->sp_magic);
 	sp->sp_nblocks = SWAPL(sp->sp_nblocks);
+	sp->sp_flags = SWAPL(sp->sp_flags);
 }
 
 static
@@ -126,6 +127,16 @@ swapinode(struct sfs_inode *sfi)
 	sfi->sfi_tindirect = SWAPL(sfi->sfi_tindirect);
 #endif
 #endif
+
+	sfi->sfi_flags = SWAPL(sfi->sfi_flags);
+	for (i=0; i<SFS_NEXTENTS; i++) {
+		sfi->sfi_extents[i].sfe_fileblock =
+			SWAPL(sfi->sfi_extents[i].sfe_fileblock);
+		sfi->sfi_extents[i].sfe_diskblock =
+			SWAPL(sfi->sfi_extents[i].sfe_diskblock);
+		sfi->sfi_extents[i].sfe_nblocks =
+			SWAPL(sfi->sfi_extents[i].sfe_nblocks);
+	}
 }
 
 static
@@ -522,6 +533,11 @@ check_sb(void)
 		errx(EXIT_UNRECOV, "Not an sfs filesystem");
 	}
 
+	if (sp.sp_flags & ~SFS_SPF_ALL) {
+		errx(EXIT_UNRECOV, "Unknown superblock flags 0x%lx",
+		     (unsigned long) (sp.sp_flags & ~SFS_SPF_ALL));
+	}
+
 	assert(nblocks==0);
 	assert(bitblocks==0);
 	nblocks = sp.sp_nblocks;
@@ -631,6 +647,83 @@ check_indirect_block(uint32_t ino, uint32_t *ientry, uint32_t *blockp,
 	}
 }
 
+/* returns nonzero if inode modified */
+static
+int
+check_inode_extents(uint32_t ino, struct sfs_inode *sfi, int isdir)
+{
+	struct sfs_extent *e;
+	uint32_t size, fsblocks, fileblocks, prevend, keep, j, badcount;
+	int i, ended;
+
+	badcount = 0;
+	fsblocks = nblocks;
+
+	size = SFS_ROUNDUP(sfi->sfi_size, SFS_BLOCKSIZE);
+	fileblocks = size/SFS_BLOCKSIZE;
+
+	prevend = 0;
+	ended = 0;
+	for (i=0; i<SFS_NEXTENTS; i++) {
+		e = &sfi->sfi_extents[i];
+		if (e->sfe_nblocks == 0) {
+			ended = 1;
+			if (e->sfe_fileblock != 0 || e->sfe_diskblock != 0) {
+				badcount++;
+				e->sfe_fileblock = e->sfe_diskblock = 0;
+			}
+			continue;
+		}
+		if (ended || e->sfe_fileblock < prevend ||
+		    e->sfe_diskblock == 0 ||
+		    e->sfe_diskblock >= fsblocks ||
+		    e->sfe_nblocks > fsblocks - e->sfe_diskblock) {
+			warnx("Inode %lu: extent %d is invalid (NOT FIXED)",
+			      (unsigned long) ino, i);
+			setbadness(EXIT_UNRECOV);
+			return 0;
+		}
+		prevend = e->sfe_fileblock + e->sfe_nblocks;
+
+		/* Blocks past EOF get freed. */
+		keep = e->sfe_nblocks;
+		if (e->sfe_fileblock >= fileblocks) {
+			keep = 0;
+		}
+		else if (prevend > fileblocks) {
+			keep = fileblocks - e->sfe_fileblock;
+		}
+		for (j=0; j<e->sfe_nblocks; j++) {
+			if (j < keep) {
+				bitmap_mark(e->sfe_diskblock + j,
+					    isdir ? B_DIRDATA : B_DATA, ino);
+			}
+			else {
+				badcount++;
+				bitmap_mark(e->sfe_diskblock + j,
+					    B_TOFREE, 0);
+			}
+		}
+		e->sfe_nblocks = keep;
+		if (keep == 0) {
+			/*
+			 * Everything from here on is past EOF too, so
+			 * the table stays compact.
+			 */
+			e->sfe_fileblock = e->sfe_diskblock = 0;
+		}
+	}
+
+	if (badcount > 0) {
+		warnx("Inode %lu: %lu blocks after EOF (freed)", 
+		     (unsigned long) ino, (unsigned long) badcount);
+		setbadness(EXIT_RECOV);
+		return 1;
+	}
+
+	return 0;
+}
+
 /* returns nonzero if inode modified */
 static
 int
@@ -638,6 +731,10 @@ check_inode_blocks(uint32_t ino, struct sfs_inode *sfi, int isdir)
 {
 	uint32_t size, block, nblocks, badcount;
 
+	if (sfi->sfi_flags & SFS_IF_EXTENTS) {
+		return check_inode_extents(ino, sfi, isdir);
+	}
+
 	badcount = 0;
 
 	size = SFS_ROUNDUP(sfi->sfi_size, SFS_BLOCKSIZE);
@@ -781,6 +878,20 @@ uint32_t
 dobmap(const struct sfs_inode *sfi, uint32_t fileblock)
 {
 	uint32_t iblock, offset;
+	int i;
+
+	if (sfi->sfi_flags & SFS_IF_EXTENTS) {
+		for (i=0; i<SFS_NEXTENTS; i++) {
+			const struct sfs_extent *e = &sfi->sfi_extents[i];
+
+			if (fileblock >= e->sfe_fileblock &&
+			    fileblock - e->sfe_fileblock < e->sfe_nblocks) {
+				return e->sfe_diskblock +
+					(fileblock - e->sfe_fileblock);
+			}
+		}
+		return 0;
+	}
 
 	if (fileblock < BMAP_DMAX) {
 		return BMAP_D(sfi, fileblock);
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Write at large file offsets.
+ *
+ * A block is written so it ends exactly at the largest size an SFS
+ * file can have, and read back. Writes that would end past that, and
+ * one past 4G (which doesn't fit in the on-disk size at all), should
+ * fail with EFBIG and leave the file alone. Works on both inode
+ * formats; on a volume made with "mksfs -e" it checks the extent
+ * table gets the same limit as the block map.
+ *
+ * Usage: bigseek [file]
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define BLOCKSIZE  512		/* SFS_BLOCKSIZE */
+
+/* 15 direct blocks, then single, double, and triple indirect */
+#define MAXFILEBLOCKS (15 + 128 + 128*128 + 128*128*128)
+#define MAXFILESIZE ((off_t)MAXFILEBLOCKS * BLOCKSIZE)
+
+static char buf[BLOCKSIZE];
+static char check[BLOCKSIZE];
+
+/*
+ * Check the file's size is SIZE.
+ */
+static
+void
+checksize(int fd, const char *name, off_t size, const char *when)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0) {
+		err(1, "%s: fstat", name);
+	}
+	if (st.st_size != size) {
+		errx(1, "FAILED: %s: size is %lld %s, not %lld", name,
+		     (long long)st.st_size, when, (long long)size);
+	}
+}
+
+/*
+ * Write LEN bytes at POS, which should fail with EFBIG.
+ */
+static
+void
+writebig(int fd, const char *name, off_t pos, size_t len)
+{
+	int r;
+
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek to %lld", name, (long long)pos);
+	}
+	r = write(fd, buf, len);
+	if (r >= 0) {
+		errx(1, "FAILED: %s: write of %u at %lld wrote %d", name,
+		     (unsigned)len, (long long)pos, r);
+	}
+	if (errno != EFBIG) {
+		err(1, "FAILED: %s: write of %u at %lld", name,
+		    (unsigned)len, (long long)pos);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *name = "bigseek.tmp";
+	off_t pos;
+	int fd, r, i;
+
+	if (argc > 2) {
+		errx(1, "Usage: bigseek [file]");
+	}
+	if (argc == 2) {
+		name = argv[1];
+	}
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", name);
+	}
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		buf[i] = (char)(i * 7 + 1);
+	}
+
+	/* The last block a file can have. */
+	pos = MAXFILESIZE - BLOCKSIZE;
+	printf("bigseek: writing the block at %lld\n", (long long)pos);
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek to %lld", name, (long long)pos);
+	}
+	r = write(fd, buf, BLOCKSIZE);
+	if (r < 0) {
+		err(1, "%s: write at %lld", name, (long long)pos);
+	}
+	if (r != BLOCKSIZE) {
+		errx(1, "FAILED: %s: short write at %lld", name,
+		     (long long)pos);
+	}
+	checksize(fd, name, MAXFILESIZE, "after writing the last block");
+
+	/* Anything ending past it is too big, however it's aligned. */
+	printf("bigseek: writing past the largest file size\n");
+	writebig(fd, name, MAXFILESIZE, 1);
+	writebig(fd, name, MAXFILESIZE - 1, 2);
+	writebig(fd, name, MAXFILESIZE + 100*BLOCKSIZE, BLOCKSIZE);
+	writebig(fd, name, (off_t)1 << 32, BLOCKSIZE);
+	writebig(fd, name, ((off_t)1 << 32) + BLOCKSIZE, 10);
+	checksize(fd, name, MAXFILESIZE, "after the failed writes");
+
+	/* The block is intact, and what's before it reads as zeros. */
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek to %lld", name, (long long)pos);
+	}
+	r = read(fd, check, BLOCKSIZE);
+	if (r < 0) {
+		err(1, "%s: read at %lld", name, (long long)pos);
+	}
+	if (r != BLOCKSIZE || memcmp(check, buf, BLOCKSIZE) != 0) {
+		errx(1, "FAILED: %s: the last block came back wrong", name);
+	}
+
+	pos = MAXFILESIZE / 2;
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek to %lld", name, (long long)pos);
+	}
+	r = read(fd, check, BLOCKSIZE);
+	if (r < 0) {
+		err(1, "%s: read at %lld", name, (long long)pos);
+	}
+	for (i=0; i<r; i++) {
+		if (check[i] != 0) {
+			errx(1, "FAILED: %s: hole at %lld isn't zero", name,
+			     (long long)pos);
+		}
+	}
+	if (r != BLOCKSIZE) {
+		errx(1, "FAILED: %s: short read at %lld", name,
+		     (long long)pos);
+	}
+
+	close(fd);
+	if (remove(name) < 0) {
+		err(1, "%s: remove", name);
+	}
+
+	printf("bigseek: passed.\n");
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Fill a fragmented volume with one file.
+ *
+ * Two files are grown a block at a time, in turn, until the disk is
+ * full, so their blocks end up interleaved; then one is removed, which
+ * leaves the free space in many small pieces all over the disk. A
+ * third file is then written until the disk fills again. It should
+ * get about as much space as the removed file gave back, and reading
+ * it back should give what was written.
+ *
+ * On a volume made with "mksfs -e" the third file needs far more
+ * extents than an inode holds, so this checks that SFS switches the
+ * file to a block map instead of failing with EFBIG.
+ *
+ * Usage: fragfill [directory]
+ */
+
+#include <sys/types.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define BLOCKSIZE  512		/* SFS_BLOCKSIZE */
+
+static char buf[BLOCKSIZE];
+static char name_a[128], name_b[128], name_c[128];
+
+/*
+ * Fill BUF with a pattern that depends on the file and the block.
+ */
+static
+void
+fillpattern(char *p, unsigned file, unsigned block)
+{
+	unsigned i;
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		p[i] = (char)(file * 61 + block * 7 + i);
+	}
+}
+
+/*
+ * Write block number BLOCK of file number FILE to FD. Returns 0 on
+ * success and -1 once the disk is full; anything else is fatal.
+ */
+static
+int
+writeblock(int fd, const char *name, unsigned file, unsigned block)
+{
+	int r;
+
+	fillpattern(buf, file, block);
+	r = write(fd, buf, BLOCKSIZE);
+	if (r == BLOCKSIZE) {
+		return 0;
+	}
+	if (r < 0 && errno != ENOSPC) {
+		err(1, "%s: write of block %u", name, block);
+	}
+	if (r > 0) {
+		/* Partial write: the disk just filled. Drop the tail. */
+		if (ftruncate(fd, (off_t)block * BLOCKSIZE) < 0) {
+			err(1, "%s: ftruncate", name);
+		}
+		lseek(fd, (off_t)block * BLOCKSIZE, SEEK_SET);
+	}
+	return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dir = ".";
+	int fa, fb, fc;
+	unsigned na, nb, nc, i;
+	int fulla, fullb;
+	char check[BLOCKSIZE];
+	int r;
+
+	if (argc > 2) {
+		errx(1, "Usage: fragfill [directory]");
+	}
+	if (argc == 2) {
+		dir = argv[1];
+	}
+	snprintf(name_a, sizeof(name_a), "%s/fragfill.a", dir);
+	snprintf(name_b, sizeof(name_b), "%s/fragfill.b", dir);
+	snprintf(name_c, sizeof(name_c), "%s/fragfill.c", dir);
+
+	fa = open(name_a, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fa < 0) {
+		err(1, "%s: create", name_a);
+	}
+	fb = open(name_b, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fb < 0) {
+		err(1, "%s: create", name_b);
+	}
+
+	printf("fragfill: filling the disk with two interleaved files\n");
+	na = nb = 0;
+	fulla = fullb = 0;
+	while (!fulla || !fullb) {
+		if (!fulla) {
+			fulla = writeblock(fa, name_a, 0, na) < 0;
+			if (!fulla) {
+				na++;
+			}
+		}
+		if (!fullb) {
+			fullb = writeblock(fb, name_b, 1, nb) < 0;
+			if (!fullb) {
+				nb++;
+			}
+		}
+	}
+	close(fa);
+	close(fb);
+	printf("fragfill: %u and %u blocks; removing the second\n", na, nb);
+
+	if (remove(name_b) < 0) {
+		err(1, "%s: remove", name_b);
+	}
+
+	fc = open(name_c, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fc < 0) {
+		err(1, "%s: create", name_c);
+	}
+	nc = 0;
+	while (writeblock(fc, name_c, 2, nc) == 0) {
+		nc++;
+	}
+	printf("fragfill: wrote %u blocks into the gaps\n", nc);
+
+	/*
+	 * The new file's inode and indirect blocks come out of the same
+	 * space; allow one in 64 for them, and a few more.
+	 */
+	if (nc + nc/64 + 4 < nb) {
+		errx(1, "FAILED: only %u of %u freed blocks could be used",
+		     nc, nb);
+	}
+
+	lseek(fc, 0, SEEK_SET);
+	for (i=0; i<nc; i++) {
+		r = read(fc, check, BLOCKSIZE);
+		if (r < 0) {
+			err(1, "%s: read of block %u", name_c, i);
+		}
+		if (r != BLOCKSIZE) {
+			errx(1, "FAILED: %s: short read of block %u", name_c, i);
+		}
+		fillpattern(buf, 2, i);
+		if (memcmp(check, buf, BLOCKSIZE) != 0) {
+			errx(1, "FAILED: %s: block %u came back wrong",
+			     name_c, i);
+		}
+	}
+	close(fc);
+
+	remove(name_a);
+	remove(name_c);
+
+	printf("fragfill: passed.\n");
+	return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * mmaptest - test file mappings.
+ *
+ * Maps a file of a few pages and checks that:
+ *    - a MAP_SHARED mapping sees the file's contents;
+ *    - writes through it reach the file on msync;
+ *    - write() to the file shows up in it, and a later msync keeps
+ *      what write() put there;
+ *    - a MAP_PRIVATE mapping sees the file, but its own writes stay
+ *      private, both from the file and from the shared mapping;
+ *    - munmap writes back what msync hasn't, and removes the mapping
+ *      (a child touching it afterwards should be killed);
+ *    - ftruncate zeros what a mapping holds past the new end, and
+ *      msync doesn't grow the file back;
+ *    - bad arguments fail with MAP_FAILED.
+ *
+ * Usage: mmaptest [file]
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define PAGESIZE  4096
+#define NPAGES    3
+#define FILESIZE  (NPAGES * PAGESIZE)
+
+static char buf[FILESIZE];
+static char check[FILESIZE];
+
+/*
+ * The byte at offset I of the file as first written.
+ */
+static
+char
+pattern(unsigned i)
+{
+	return (char)(i * 7 + i / PAGESIZE);
+}
+
+/*
+ * Read the whole file into CHECK, with read().
+ */
+static
+void
+readfile(int fd, const char *name)
+{
+	int r;
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "%s: lseek", name);
+	}
+	r = read(fd, check, FILESIZE);
+	if (r < 0) {
+		err(1, "%s: read", name);
+	}
+	if (r != FILESIZE) {
+		errx(1, "FAILED: %s: short read (%d bytes)", name, r);
+	}
+}
+
+/*
+ * Write LEN bytes of C at offset POS of the file, with write(), and
+ * note them in BUF.
+ */
+static
+void
+writefile(int fd, const char *name, unsigned pos, char c, unsigned len)
+{
+	int r;
+
+	memset(buf + pos, c, len);
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek", name);
+	}
+	r = write(fd, buf + pos, len);
+	if (r < 0) {
+		err(1, "%s: write", name);
+	}
+	if ((unsigned)r != len) {
+		errx(1, "FAILED: %s: short write (%d bytes)", name, r);
+	}
+}
+
+/*
+ * Compare the file-sized region at P with what we expect, BUF.
+ */
+static
+void
+compare(const char *p, const char *what)
+{
+	unsigned i;
+
+	for (i=0; i<FILESIZE; i++) {
+		if (p[i] != buf[i]) {
+			errx(1, "FAILED: %s: byte %u is %d, should be %d",
+			     what, i, p[i], buf[i]);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *name = "mmaptest.dat";
+	char *shared, *private;
+	volatile char *vp;
+	struct stat st;
+	unsigned i;
+	pid_t pid;
+	int fd, status;
+
+	if (argc > 2) {
+		errx(1, "Usage: mmaptest [file]");
+	}
+	if (argc == 2) {
+		name = argv[1];
+	}
+
+	for (i=0; i<FILESIZE; i++) {
+		buf[i] = pattern(i);
+	}
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", name);
+	}
+	if (write(fd, buf, FILESIZE) != FILESIZE) {
+		err(1, "%s: write", name);
+	}
+
+	/* Bad arguments */
+	if (mmap(NULL, FILESIZE, PROT_READ, MAP_SHARED, fd, 1) != MAP_FAILED) {
+		errx(1, "FAILED: mmap at an unaligned offset worked");
+	}
+	if (mmap(NULL, FILESIZE, PROT_READ, MAP_SHARED|MAP_PRIVATE, fd, 0)
+	    != MAP_FAILED) {
+		errx(1, "FAILED: mmap with both MAP_SHARED and MAP_PRIVATE "
+		     "worked");
+	}
+	if (mmap(NULL, FILESIZE, PROT_READ, MAP_SHARED, -1, 0)
+	    != MAP_FAILED) {
+		errx(1, "FAILED: mmap of a bad file handle worked");
+	}
+	printf("mmaptest: bad arguments rejected\n");
+
+	/* MAP_SHARED sees the file, and msync writes it back */
+	shared = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shared == MAP_FAILED) {
+		err(1, "mmap MAP_SHARED");
+	}
+	compare(shared, "shared mapping");
+
+	shared[0] = buf[0] = 'S';
+	shared[PAGESIZE*2 + 5] = buf[PAGESIZE*2 + 5] = 'S';
+	if (msync(shared, FILESIZE, MS_SYNC) < 0) {
+		err(1, "msync");
+	}
+	readfile(fd, name);
+	compare(check, "file after msync");
+	printf("mmaptest: MAP_SHARED and msync ok\n");
+
+	/* write() shows up in the mapping... */
+	writefile(fd, name, PAGESIZE + 100, 'W', 10);
+	compare(shared, "shared mapping after write()");
+
+	/* ...and msync after it writes back the page with it in */
+	shared[PAGESIZE + 3] = buf[PAGESIZE + 3] = 'M';
+	if (msync(shared, FILESIZE, MS_SYNC) < 0) {
+		err(1, "msync");
+	}
+	readfile(fd, name);
+	compare(check, "file after write() then msync");
+
+	/* even if the page was written through the mapping first */
+	shared[PAGESIZE*2 + 7] = buf[PAGESIZE*2 + 7] = 'D';
+	writefile(fd, name, PAGESIZE*2 + 200, 'V', 10);
+	compare(shared, "dirty shared mapping after write()");
+	if (msync(shared, FILESIZE, MS_SYNC) < 0) {
+		err(1, "msync");
+	}
+	readfile(fd, name);
+	compare(check, "file after mapping write, write(), msync");
+	printf("mmaptest: write() with a mapping ok\n");
+
+	/* MAP_PRIVATE sees the file, but keeps its writes to itself */
+	private = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+		       fd, 0);
+	if (private == MAP_FAILED) {
+		err(1, "mmap MAP_PRIVATE");
+	}
+	if (private == shared) {
+		errx(1, "FAILED: both mappings at the same address");
+	}
+	compare(private, "private mapping");
+
+	private[0] = 'P';
+	private[PAGESIZE + 1] = 'P';
+	compare(shared, "shared mapping after private write");
+	readfile(fd, name);
+	compare(check, "file after private write");
+	if (private[0] != 'P' || private[PAGESIZE + 1] != 'P') {
+		errx(1, "FAILED: private write did not stick");
+	}
+	if (munmap(private, FILESIZE) < 0) {
+		err(1, "munmap MAP_PRIVATE");
+	}
+	readfile(fd, name);
+	compare(check, "file after private munmap");
+	printf("mmaptest: MAP_PRIVATE ok\n");
+
+	/* munmap writes back what msync hasn't */
+	shared[PAGESIZE + 9] = buf[PAGESIZE + 9] = 'U';
+	if (munmap(shared, FILESIZE) < 0) {
+		err(1, "munmap MAP_SHARED");
+	}
+	readfile(fd, name);
+	compare(check, "file after munmap");
+
+	/* ...and the mapping is gone */
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		vp = shared;
+		vp[0] = 'X';
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		errx(1, "FAILED: child wrote to an unmapped mapping");
+	}
+	printf("mmaptest: munmap ok\n");
+
+	/* ftruncate clears the mapping past the end, and msync obeys it */
+	shared = mmap(NULL, FILESIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shared == MAP_FAILED) {
+		err(1, "mmap MAP_SHARED");
+	}
+	compare(shared, "second shared mapping");
+	if (ftruncate(fd, PAGESIZE + 10) < 0) {
+		err(1, "%s: ftruncate", name);
+	}
+	for (i=PAGESIZE + 10; i<PAGESIZE*2; i++) {
+		if (shared[i] != 0) {
+			errx(1, "FAILED: byte %u is still there after "
+			     "ftruncate", i);
+		}
+	}
+	shared[0] = 'T';
+	if (msync(shared, FILESIZE, MS_SYNC) < 0) {
+		err(1, "msync");
+	}
+	if (fstat(fd, &st) < 0) {
+		err(1, "%s: fstat", name);
+	}
+	if (st.st_size != PAGESIZE + 10) {
+		errx(1, "FAILED: msync made the file %lld bytes",
+		     (long long)st.st_size);
+	}
+	if (munmap(shared, FILESIZE) < 0) {
+		err(1, "munmap MAP_SHARED");
+	}
+	printf("mmaptest: ftruncate with a mapping ok\n");
+
+	close(fd);
+	remove(name);
+
+	printf("mmaptest: passed.\n");
+	return 0;
+}